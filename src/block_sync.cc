@@ -1,5 +1,8 @@
 #include "block_sync.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace redsea {
 
 namespace {
@@ -10,6 +13,33 @@ const unsigned kBitmask28 = 0xFFFFFFF;
 
 const unsigned kMaxErrorLength = 5;
 
+// Soft decision decoding flips every combination of this many least
+// reliable bits of an uncorrectable block
+const int kChaseBits = 5;
+
+// A soft correction is accepted if the reliabilities of the flipped bits add
+// up to less than kMaxSoftCost times the block's mean reliability, and less
+// than kMinSoftMargin times the cost of making the block a codeword for any
+// other offset. Looser limits correct more blocks in heavy noise, but also
+// miscorrect more than hard decoding alone.
+const float kMaxSoftCost = 1.0f;
+const float kMinSoftMargin = 0.4f;
+
+// 228 kHz samples per bit at 1187.5 bps
+const int kSamplesPerBit = 192;
+
+// Averaging constant of the block error rate reported to Subcarrier. Until
+// 1/kBlockErrorAveraging blocks have been received after sync, the rate is
+// the plain mean of those; below kMinErrorRateBlocks it is reported as 1, so
+// that the loops aren't narrowed on a rate that hasn't been measured yet.
+const float kBlockErrorAveraging = 0.05f;
+const unsigned kMinErrorRateBlocks = 8;
+
+// A block is taken for block A of the last known PI if it differs from that
+// codeword in at most this many bits; one bit keeps false hits on noise to
+// about one an hour
+const int kMaxPIBitErrors = 1;
+
 const std::vector<uint16_t> offset_word = {0x0FC, 0x198, 0x168, 0x350, 0x1B4};
 const std::vector<uint16_t> block_for_offset = {0, 1, 2, 2, 3};
 
@@ -40,6 +70,19 @@ uint32_t calcSyndrome(uint32_t vec) {
   return matrixMultiply(vec, parity_check_matrix);
 }
 
+// The 26-bit block carrying message with the given offset word. The check
+// word is the remainder of message * x^10 divided by the generator polynomial
+// x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1 (Section B.1.1), plus the offset.
+uint32_t encodeBlock(uint16_t message, uint16_t offset) {
+  const uint32_t generator = 0x5B9;
+  uint32_t block = uint32_t(message) << 10;
+  uint32_t remainder = block;
+  for (int i=25; i>=10; i--)
+    if ((remainder >> i) & 1)
+      remainder ^= generator << (i - 10);
+  return block | (remainder ^ offset);
+}
+
 eOffset nextOffsetFor(eOffset o) {
   static const std::map<eOffset,eOffset> next_offset({
       {A,B}, {B,C}, {C,D}, {CI,D}, {D,A}
@@ -63,29 +106,65 @@ std::map<uint16_t,uint16_t> makeErrorLookupTable() {
   return result;
 }
 
+// Bursts of up to kMaxErrorLength anywhere in a 26-bit block, check bits
+// included, indexed by the 10-bit syndrome; 0 for syndromes that no burst
+// has. Where two bursts have the same syndrome, the one with fewer errors.
+std::vector<uint32_t> makeBlockErrorLookupTable() {
+
+  std::vector<uint32_t> result(1 << 10);
+
+  for (uint32_t e=1; e < (1<<kMaxErrorLength); e++) {
+    for (unsigned shift=0; shift < 26; shift++) {
+      uint32_t errvec = (e << shift) & kBitmask26;
+
+      uint16_t sy = calcSyndrome(errvec);
+      if (result[sy] == 0 ||
+          __builtin_popcount(errvec) < __builtin_popcount(result[sy]))
+        result[sy] = errvec;
+    }
+  }
+  return result;
+}
+
 } // namespace
 
-BlockStream::BlockStream(eInputType input_type) : bitcount_(0),
-  prevbitcount_(0), left_to_read_(0), wideblock_(0), prevsync_(0),
+BlockStream::BlockStream(const Options& options, int stream) : bitcount_(0),
+  prevbitcount_(0), left_to_read_(1), wideblock_(0), prevsync_(0),
   block_counter_(0), expected_offset_(A), pi_(0), has_sync_for_(5),
   is_in_sync_(false), group_data_(4), has_block_(5), block_has_errors_(50),
-  subcarrier_(), ascii_bits_(), has_new_group_(false),
+  subcarrier_(options, stream), ascii_bits_(), has_new_group_(false),
   error_lookup_(makeErrorLookupTable()), data_length_(0),
-  input_type_(input_type), is_eof_(false) {
+  input_type_(options.input_type), is_eof_(false), num_bits_(0),
+  groups_(),
+  group_info_(), group_start_(0), last_sample_(0), group_start_sample_(0),
+  is_block_corrected_(4),
+  block_error_rate_(1.0f), num_blocks_in_sync_(0), reliability_(28, 0.0f),
+  use_soft_decoding_(options.input_type == INPUT_MPX), pi_block_(0),
+  is_flywheeling_(false), bit_slip_(0),
+  filter_(stream == 0 ? options.filter : GroupFilter()),
+  is_group_filtered_(false),
+  use_cycle_counter_(!options.stats_path.empty()), stats_() {
 
 }
 
-int BlockStream::getNextBit() {
-  int result = 0;
+SoftBit BlockStream::getNextBit() {
+  SoftBit result = {0, 0.0f, 0};
   if (input_type_ == INPUT_MPX) {
     result = subcarrier_.getNextBit();
     is_eof_ = subcarrier_.isEOF();
+    // The bit is the first after the gap, so the gap is handled before the
+    // caller pushes it
+    if (subcarrier_.popGap())
+      handleGap();
 
   } else if (input_type_ == INPUT_ASCIIBITS) {
-    result = ascii_bits_.getNextBit();
+    result = {ascii_bits_.getNextBit(), 1.0f, 0};
     is_eof_ = ascii_bits_.isEOF();
   }
 
+  if (!is_eof_)
+    num_bits_++;
+
   return result;
 }
 
@@ -105,6 +184,86 @@ uint32_t BlockStream::correctBurstErrors(uint32_t block) const {
 
 }
 
+// Cost of making the block a codeword for this offset: the smallest sum of
+// reliabilities of the bits to flip, found by Chase decoding. Every
+// combination of the kChaseBits least reliable bits is tried, with the
+// remaining syndrome corrected as a burst. Returns infinity if none works.
+float BlockStream::softErrorCost(uint32_t block, eOffset offset,
+    uint32_t* errors) const {
+
+  // Shared by all instances
+  static const std::vector<uint32_t> block_error_lookup =
+    makeBlockErrorLookupTable();
+
+  // Block bit i is bit i+1 of wideblock_. The kChaseBits least reliable
+  // bits are kept in order by insertion.
+  std::vector<int> least_reliable;
+  for (int i=0; i<26; i++) {
+    int k = least_reliable.size();
+    while (k > 0 && reliability_[i+1] < reliability_[least_reliable[k-1]+1])
+      k --;
+    if (k < kChaseBits) {
+      least_reliable.insert(least_reliable.begin() + k, i);
+      if ((int)least_reliable.size() > kChaseBits)
+        least_reliable.pop_back();
+    }
+  }
+
+  float min_cost = INFINITY;
+
+  for (uint32_t test=0; test < (1u << kChaseBits); test++) {
+    uint32_t pattern = 0;
+    for (int k=0; k<kChaseBits; k++)
+      if ((test >> k) & 1)
+        pattern |= 1u << least_reliable[k];
+
+    uint16_t sy = calcSyndrome(block ^ pattern ^ offset_word[offset]);
+    if (sy != 0x000) {
+      if (block_error_lookup[sy] == 0)
+        continue;
+      pattern ^= block_error_lookup[sy];
+    }
+
+    float cost = 0.0f;
+    for (int i=0; i<26; i++)
+      if ((pattern >> i) & 1)
+        cost += reliability_[i+1];
+
+    if (cost < min_cost) {
+      min_cost = cost;
+      *errors = pattern;
+    }
+  }
+
+  return min_cost;
+}
+
+// Soft decision version of correctBurstErrors. To guard against
+// miscorrection, the block must be much closer to a codeword with the
+// expected offset than to one with any other offset.
+uint32_t BlockStream::correctSoftErrors(uint32_t block) const {
+
+  uint32_t errors = 0;
+  float cost = softErrorCost(block, expected_offset_, &errors);
+
+  float mean_reliability = 0.0f;
+  for (int i=1; i<=26; i++)
+    mean_reliability += reliability_[i];
+  mean_reliability /= 26;
+
+  if (cost > kMaxSoftCost * mean_reliability)
+    return block;
+
+  for (eOffset o : {A, B, C, CI, D}) {
+    uint32_t other_errors;
+    if (o != expected_offset_ &&
+        cost > kMinSoftMargin * softErrorCost(block, o, &other_errors))
+      return block;
+  }
+
+  return block ^ errors ^ offset_word[expected_offset_];
+}
+
 // When a block can't be decoded, save the beginning of the group if possible
 void BlockStream::uncorrectable() {
   data_length_ = 0;
@@ -122,25 +281,54 @@ void BlockStream::uncorrectable() {
     }
   }
 
-  block_has_errors_[block_counter_ % block_has_errors_.size()] = true;
+  for (eOffset o : {A, B, C, CI, D})
+    has_block_[o] = false;
 
-  unsigned erroneous_blocks = 0;
-  for (bool e : block_has_errors_) {
-    if (e)
-      erroneous_blocks ++;
-  }
+}
 
-  // Sync is lost when >45 out of last 50 blocks are erroneous (Section C.1.2)
-  if (is_in_sync_ && erroneous_blocks > 45) {
-    is_in_sync_ = false;
-    for (unsigned i=0; i<block_has_errors_.size(); i++)
-      block_has_errors_[i] = false;
-    pi_ = 0x0000;
+// The PI is kept for reacquisition by matchesPI()
+void BlockStream::loseSync() {
+  if (is_in_sync_)
+    stats_.num_losses ++;
+  is_in_sync_ = false;
+  is_flywheeling_ = false;
+  for (unsigned i=0; i<block_has_errors_.size(); i++)
+    block_has_errors_[i] = false;
+}
+
+// The bits after a gap in the input don't continue those before it. The
+// blocks received of the current group are saved as a partial group, and
+// the block phase is searched for anew once a block of only new bits has
+// been read. Syndromes before the gap aren't paired with those after it.
+void BlockStream::handleGap() {
+  if (is_in_sync_) {
+    uncorrectable();
+    queueGroup();
   }
+  loseSync();
+  expected_offset_ = A;
+  bit_slip_ = 0;
+  left_to_read_ = 27;
+  prevbitcount_ = bitcount_ - 157;
+}
 
-  for (eOffset o : {A, B, C, CI, D})
-    has_block_[o] = false;
+// Whether the block looks like block A of the last known PI
+bool BlockStream::matchesPI(uint32_t block) const {
+  return pi_ != 0 &&
+    __builtin_popcount(block ^ pi_block_) <= kMaxPIBitErrors;
+}
 
+// The flywheel keeps counting blocks through a fade, but the symbol clock
+// may slip while the signal is gone. Block A of the last known PI is looked
+// for at every bit position in between, and the block phase moved there if
+// it's found. The blocks received of the group before it are saved as a
+// partial group, unless uncorrectable() already did that.
+void BlockStream::realignToPI() {
+  stats_.num_realignments ++;
+  uncorrectable();
+  queueGroup();
+  expected_offset_ = A;
+  left_to_read_ = 0;
 }
 
 bool BlockStream::checkAndAcquireSync(uint32_t block) {
@@ -152,6 +340,13 @@ bool BlockStream::checkAndAcquireSync(uint32_t block) {
     has_sync_for_any |= has_sync_for_[o];
   }
 
+  // Sync on a single block if it carries the PI we had before
+  if (!is_in_sync_ && matchesPI(block)) {
+    is_in_sync_ = true;
+    expected_offset_ = A;
+    stats_.num_acquisitions ++;
+  }
+
   // If not already in sync, try to find the repeating offset sequence
   if (!is_in_sync_) {
     if (has_sync_for_any) {
@@ -164,6 +359,7 @@ bool BlockStream::checkAndAcquireSync(uint32_t block) {
               block_for_offset[o]) {
             is_in_sync_ = true;
             expected_offset_ = o;
+            stats_.num_acquisitions ++;
             //printf(":sync!\n");
           } else {
             prevbitcount_ = bitcount_;
@@ -178,111 +374,326 @@ bool BlockStream::checkAndAcquireSync(uint32_t block) {
 
 }
 
-std::vector<uint16_t> BlockStream::getNextGroup() {
+void BlockStream::pushSamples(const std::vector<int16_t>& samples) {
+  std::vector<SoftBit> bits = subcarrier_.demodulate(samples);
+  if (subcarrier_.popGap())
+    handleGap();
+  for (SoftBit bit : bits)
+    pushBit(bit);
+}
 
-  has_new_group_ = false;
-  data_length_ = 0;
+// Decimated baseband from a SubcarrierBank
+void BlockStream::pushBaseband(
+    const std::vector<std::complex<float>>& samples) {
+  if (subcarrier_.popGap())
+    handleGap();
+  std::vector<SoftBit> bits;
+  for (std::complex<float> sample : samples)
+    subcarrier_.demodulateBaseband(sample, &bits);
+  for (SoftBit bit : bits)
+    pushBit(bit);
+}
 
-  while (!(has_new_group_ || isEOF())) {
+void BlockStream::skipSamples(uint64_t num_samples) {
+  subcarrier_.skipSamples(num_samples);
+}
 
-    // Compensate for clock slip corrections
-    bitcount_ += 26 - left_to_read_;
+bool BlockStream::gate(const std::vector<int16_t>& samples) {
+  return subcarrier_.gate(samples);
+}
 
-    // Read from radio
-    for (int i=0; i < (is_in_sync_ ? (int)left_to_read_ : 1); i++,bitcount_++) {
-      wideblock_ = (wideblock_ << 1) + getNextBit();
-    }
+void BlockStream::pushBit(SoftBit bit) {
+  uint64_t start_cycles = (use_cycle_counter_ ? readCycleCounter() : 0);
+
+  wideblock_ = (wideblock_ << 1) + bit.value;
+  reliability_.push_front(bit.reliability);
+  reliability_.pop_back();
+  last_sample_ = (input_type_ == INPUT_MPX ? bit.sample :
+                  bitcount_ * kSamplesPerBit);
+  bitcount_ ++;
+  left_to_read_ --;
+
+  if (is_flywheeling_ && left_to_read_ > 0 &&
+      matchesPI((wideblock_ >> 1) & kBitmask26))
+    realignToPI();
+
+  if (left_to_read_ == 0) {
+    bool was_in_sync = is_in_sync_;
+    bit_slip_ = 0;
+    findBlockInInputStream();
+    left_to_read_ = (is_in_sync_ ? 26 + bit_slip_ : 1);
+
+    // Let the demodulator adapt its loops, or reacquire
+    if (input_type_ == INPUT_MPX && (is_in_sync_ || was_in_sync))
+      subcarrier_.updateSync(is_in_sync_,
+          num_blocks_in_sync_ < kMinErrorRateBlocks ? 1.0f :
+          block_error_rate_);
+  }
 
-    left_to_read_ = 26;
-    wideblock_ &= kBitmask28;
+  if (use_cycle_counter_)
+    stats_.cycles += readCycleCounter() - start_cycles;
+}
 
-    uint32_t block = (wideblock_ >> 1) & kBitmask26;
+bool BlockStream::hasGroup() const {
+  return !groups_.empty();
+}
 
-    if (!checkAndAcquireSync(block))
-      continue;
+std::vector<uint16_t> BlockStream::popGroup(GroupInfo* info) {
+  std::vector<uint16_t> result = groups_.front();
+  groups_.pop_front();
+  if (info != nullptr)
+    *info = group_info_.front();
+  group_info_.pop_front();
+  return result;
+}
 
-    block_counter_ ++;
-    uint16_t message = block >> 10;
+void BlockStream::findBlockInInputStream() {
 
-    if (expected_offset_ == C && !has_sync_for_[C] && has_sync_for_[CI]) {
-      expected_offset_ = CI;
-    }
+  wideblock_ &= kBitmask28;
 
-    if ( !has_sync_for_[expected_offset_]) {
+  uint32_t block = (wideblock_ >> 1) & kBitmask26;
+
+  if (!checkAndAcquireSync(block))
+    return;
+
+  block_counter_ ++;
+  uint16_t message = block >> 10;
+
+  if (expected_offset_ == A)
+    is_group_filtered_ = false;
+
+  bool is_corrected = false;
+  bool is_soft_correction_skipped = false;
 
-      // If message is a correct PI, error was probably in check bits
-      if (expected_offset_ == A && message == pi_ && pi_ != 0) {
-        has_sync_for_[A] = true;
-        //printf(":offset 0: ignoring error in check bits\n");
-      } else if (expected_offset_ == C && message == pi_ && pi_ != 0) {
-        has_sync_for_[CI] = true;
-        //printf(":offset 0: ignoring error in check bits\n");
-
-      // Detect & correct clock slips (Section C.1.2)
-      } else if (expected_offset_ == A && pi_ != 0 &&
-          ((wideblock_ >> 12) & kBitmask16) == pi_) {
-        message = pi_;
-        wideblock_ >>= 1;
-        has_sync_for_[A] = true;
-        //printf(":offset 0: clock slip corrected\n");
-      } else if (expected_offset_ == A && pi_ != 0 &&
-          ((wideblock_ >> 10) & kBitmask16) == pi_) {
-        message = pi_;
-        wideblock_ = (wideblock_ << 1) + getNextBit();
-        has_sync_for_[A] = true;
-        left_to_read_ = 25;
-        //printf(":offset 0: clock slip corrected\n");
-
-      // Detect & correct burst errors (Section B.2.2)
-      } else {
-
-        block = correctBurstErrors(block);
-        if (calcSyndrome(block) == 0x000) {
-          message = block >> 10;
+  if (expected_offset_ == C && !has_sync_for_[C] && has_sync_for_[CI]) {
+    expected_offset_ = CI;
+  }
+
+  if ( !has_sync_for_[expected_offset_]) {
+
+    // If message is a correct PI, error was probably in check bits
+    if (expected_offset_ == A && message == pi_ && pi_ != 0) {
+      has_sync_for_[A] = true;
+      stats_.num_blocks_check_bits ++;
+      //printf(":offset 0: ignoring error in check bits\n");
+    } else if (expected_offset_ == C && message == pi_ && pi_ != 0) {
+      has_sync_for_[CI] = true;
+      stats_.num_blocks_check_bits ++;
+      //printf(":offset 0: ignoring error in check bits\n");
+
+    // Detect & correct clock slips (Section C.1.2): the block started a bit
+    // earlier than expected, so the next one is read a bit sooner
+    } else if (expected_offset_ == A && pi_ != 0 &&
+        ((wideblock_ >> 12) & kBitmask16) == pi_) {
+      message = pi_;
+      bit_slip_ = -1;
+      has_sync_for_[A] = true;
+      stats_.num_blocks_clock_slip ++;
+      //printf(":offset 0: clock slip corrected\n");
+
+    // The block started a bit later than expected
+    } else if (expected_offset_ == A && pi_ != 0 &&
+        ((wideblock_ >> 10) & kBitmask16) == pi_) {
+      message = pi_;
+      bit_slip_ = 1;
+      has_sync_for_[A] = true;
+      stats_.num_blocks_clock_slip ++;
+      //printf(":offset 0: clock slip corrected\n");
+
+    // Detect & correct burst errors (Section B.2.2)
+    } else {
+
+      uint32_t corrected_block = correctBurstErrors(block);
+      if (calcSyndrome(corrected_block) == 0x000) {
+        message = corrected_block >> 10;
+        has_sync_for_[expected_offset_] = true;
+        is_corrected = true;
+        stats_.num_blocks_burst_corrected ++;
+
+      // Detect & correct random errors using bit reliabilities; skipped
+      // in groups that are filtered out anyway
+      } else if (use_soft_decoding_ && !is_group_filtered_) {
+        corrected_block = correctSoftErrors(block);
+        if (calcSyndrome(corrected_block) == 0x000) {
+          message = corrected_block >> 10;
           has_sync_for_[expected_offset_] = true;
+          is_corrected = true;
+          stats_.num_blocks_soft_corrected ++;
         }
-
+      } else if (use_soft_decoding_) {
+        is_soft_correction_skipped = true;
       }
 
-      // Still no sync pulse
-      if ( !has_sync_for_[expected_offset_]) {
-        uncorrectable();
-      }
     }
 
-    // Error-free block received
+    // Still no sync pulse
+    if ( !has_sync_for_[expected_offset_]) {
+      uncorrectable();
+      stats_.num_blocks_uncorrectable ++;
+    }
+  } else {
+    stats_.num_blocks_ok ++;
+  }
 
-    if (has_sync_for_[expected_offset_]) {
+  // Burst and soft corrections often "succeed" on noise, so corrected
+  // blocks count as erroneous for the flywheel
+  const bool has_errors = !has_sync_for_[expected_offset_];
+  is_flywheeling_ = has_errors || is_corrected;
 
-      group_data_[block_for_offset[expected_offset_]] = message;
-      has_block_[expected_offset_] = true;
+  block_has_errors_[block_counter_ % block_has_errors_.size()] =
+    is_flywheeling_;
 
-      if (expected_offset_ == A) {
-        pi_ = message;
-      }
+  unsigned erroneous_blocks = 0;
+  for (bool e : block_has_errors_) {
+    if (e)
+      erroneous_blocks ++;
+  }
 
-      // Complete group received
-      if (has_block_[A] && has_block_[B] && (has_block_[C] ||
-          has_block_[CI]) && has_block_[D]) {
-        has_new_group_ = true;
-        data_length_ = 4;
-      }
-    }
+  // Only counted while in sync, so that the rate is measured anew after
+  // each new sync. Blocks left uncorrected because their group was filtered
+  // out would inflate it, so they are left out.
+  if (!(has_errors && is_soft_correction_skipped)) {
+    num_blocks_in_sync_ ++;
+    block_error_rate_ += std::max(kBlockErrorAveraging,
+        1.0f / num_blocks_in_sync_) *
+      ((has_errors ? 1.0f : 0.0f) - block_error_rate_);
+  }
+
+  // Sync is lost when >45 out of last 50 blocks are erroneous (Section C.1.2)
+  if (erroneous_blocks > 45)
+    loseSync();
+
+  if (!is_in_sync_) {
+    block_error_rate_ = 1.0f;
+    num_blocks_in_sync_ = 0;
+  }
+
+  // Error-free block received
 
-    expected_offset_ = nextOffsetFor(expected_offset_);
+  if (has_sync_for_[expected_offset_]) {
+
+    group_data_[block_for_offset[expected_offset_]] = message;
+    is_block_corrected_[block_for_offset[expected_offset_]] = is_corrected;
+    has_block_[expected_offset_] = true;
 
     if (expected_offset_ == A) {
-      for (eOffset o : {A, B, C, CI, D})
-        has_block_[o] = false;
+      group_start_ = bitcount_;
+      uint64_t length = (26 - bit_slip_) * kSamplesPerBit;
+      group_start_sample_ = (last_sample_ > length ? last_sample_ - length : 0);
+    }
+
+    // A corrected PI may be a miscorrection of noise
+    if (expected_offset_ == A && message != pi_ && !is_corrected) {
+      pi_ = message;
+      pi_block_ = encodeBlock(pi_, offset_word[A]);
     }
 
+    // The rest of the group is still read for sync, but not corrected or
+    // queued
+    if ((expected_offset_ == A && !filter_.isWantedPI(message)) ||
+        (expected_offset_ == B && !filter_.isDecodedType(message)))
+      is_group_filtered_ = true;
+
+    // Complete group received
+    if (has_block_[A] && has_block_[B] && (has_block_[C] ||
+        has_block_[CI]) && has_block_[D]) {
+      has_new_group_ = true;
+      data_length_ = 4;
+    }
   }
 
-  auto result = group_data_;
-  result.resize(data_length_);
+  expected_offset_ = nextOffsetFor(expected_offset_);
 
-  return result;
+  if (expected_offset_ == A) {
+    for (eOffset o : {A, B, C, CI, D})
+      has_block_[o] = false;
+  }
+
+  queueGroup();
+
+}
+
+// Queues the group completed by the last block or saved by uncorrectable()
+void BlockStream::queueGroup() {
+  if (!has_new_group_)
+    return;
+
+  std::vector<uint16_t> group = group_data_;
+  group.resize(data_length_);
+  // Groups of other types are still queued as their block A, since
+  // GroupHandler confirms the PI on every group
+  if (filter_.isWantedPI(group[0])) {
+    if (is_group_filtered_ || !filter_.isDecoded(group))
+      group.resize(1);
+    groups_.push_back(group);
+    group_info_.push_back({group_start_, group_start_sample_,
+                           is_block_corrected_});
+  }
+  has_new_group_ = false;
+  data_length_ = 0;
+}
+
+std::vector<uint16_t> BlockStream::getNextGroup(GroupInfo* info,
+    int max_bits) {
+
+  int num_bits = 0;
+  while (groups_.empty() && !isEOF() &&
+         (max_bits <= 0 || num_bits < max_bits)) {
+    pushBit(getNextBit());
+    num_bits++;
+  }
+
+  if (isEOF())
+    finishBlock();
+
+  if (groups_.empty())
+    return std::vector<uint16_t>();
+
+  return popGroup(info);
+
+}
+
+// Finishes the block that was being read when the input ended
+void BlockStream::finishBlock() {
+  while (left_to_read_ < (is_in_sync_ ? 26u : 1u))
+    pushBit({0, 0.0f, 0});
+}
+
+void BlockStream::endInput() {
+  finishBlock();
+  subcarrier_.endInput();
+}
+
+void BlockStream::setLabel(const std::string& label) {
+  subcarrier_.setLabel(label);
+}
+
+void BlockStream::setRDSRangeHandler(
+    const std::function<void(double start, double end)>& handler) {
+  subcarrier_.setRDSRangeHandler(handler);
+}
+
+void BlockStream::setDiagnosticHandler(
+    const std::function<void(const std::string& line)>& handler) {
+  subcarrier_.setDiagnosticHandler(handler);
+}
+
+uint16_t BlockStream::getPI() const {
+  return pi_;
+}
+
+double BlockStream::getTime() const {
+  return bitcount_ / 1187.5;
+}
+
+DemodStats BlockStream::getDemodStats() const {
+  DemodStats stats = subcarrier_.getStats();
+  stats.num_bits = num_bits_;
+  return stats;
+}
 
+const SyncStats& BlockStream::getSyncStats() const {
+  return stats_;
 }
 
 bool BlockStream::isEOF() const {
@@ -1,9 +1,13 @@
 #ifndef BLOCK_SYNC_H_
 #define BLOCK_SYNC_H_
 
+#include <deque>
+#include <functional>
 #include <map>
 
 #include "ascii_in.h"
+#include "common.h"
+#include "stats.h"
 #include "subcarrier.h"
 
 namespace redsea {
@@ -12,28 +16,69 @@ enum eOffset {
   A, B, C, CI, D
 };
 
-enum eInputType {
-  INPUT_MPX, INPUT_ASCIIBITS, INPUT_RDSSPY
-};
-
-enum eOutputType {
-  OUTPUT_HEX, OUTPUT_JSON
+// Where a group started in the bit stream and in the input samples (at
+// 228 kHz; nominal for bit input), and which of its blocks were burst or soft
+// corrected
+struct GroupInfo {
+  uint64_t start_bit;
+  uint64_t start_sample;
+  std::vector<bool> is_corrected;
 };
 
 class BlockStream {
   public:
-  BlockStream(eInputType input_type=INPUT_MPX);
-  std::vector<uint16_t> getNextGroup();
+  BlockStream(const Options& options=Options(), int stream=0);
+  // Returns an empty group if max_bits (when above 0) are read without one
+  std::vector<uint16_t> getNextGroup(GroupInfo* info=nullptr, int max_bits=0);
   bool isEOF() const;
 
+  // Push interface, for when the caller owns the input
+  void pushSamples(const std::vector<int16_t>& samples);
+  void pushBaseband(const std::vector<std::complex<float>>& samples);
+  // Input samples at 228 kHz that won't be pushed, e.g. while a channel is
+  // unoccupied; the timestamps stay on the input's clock
+  void skipSamples(uint64_t num_samples);
+  // The RDS detector (-g) on the MPX of baseband pushed with pushBaseband();
+  // returns whether to push it, or else skips the samples
+  bool gate(const std::vector<int16_t>& samples);
+  void pushBit(SoftBit bit);
+  bool hasGroup() const;
+  std::vector<uint16_t> popGroup(GroupInfo* info=nullptr);
+  // Flushes the last block and prints the demodulator's diagnostics
+  void endInput();
+  // Appended to the demodulator's diagnostics
+  void setLabel(const std::string& label);
+  // Where the RDS detector (-g) found RDS, in seconds, instead of stderr
+  void setRDSRangeHandler(
+      const std::function<void(double start, double end)>& handler);
+  // Where the other diagnostics (-e, -C) go, instead of stderr
+  void setDiagnosticHandler(
+      const std::function<void(const std::string& line)>& handler);
+  // The PI of the last error-free block A, or 0
+  uint16_t getPI() const;
+  // Seconds of input so far, counted in bits
+  double getTime() const;
+  // The subcarrier's counters, with the bits counted here for any input
+  DemodStats getDemodStats() const;
+  const SyncStats& getSyncStats() const;
+
   private:
-  int getNextBit();
+  SoftBit getNextBit();
+  void findBlockInInputStream();
   void uncorrectable();
+  void loseSync();
+  void handleGap();
+  void finishBlock();
+  bool matchesPI(uint32_t block) const;
+  void realignToPI();
+  void queueGroup();
   uint32_t correctBurstErrors(uint32_t block) const;
+  float softErrorCost(uint32_t block, eOffset offset, uint32_t* errors) const;
+  uint32_t correctSoftErrors(uint32_t block) const;
   bool checkAndAcquireSync(uint32_t block);
 
-  unsigned bitcount_;
-  unsigned prevbitcount_;
+  uint64_t bitcount_;
+  uint64_t prevbitcount_;
   unsigned left_to_read_;
   uint32_t wideblock_;
   unsigned prevsync_;
@@ -52,6 +97,33 @@ class BlockStream {
   unsigned data_length_;
   const eInputType input_type_;
   bool is_eof_;
+  uint64_t num_bits_;
+  std::deque<std::vector<uint16_t>> groups_;
+  std::deque<GroupInfo> group_info_;
+  uint64_t group_start_;
+  // Input sample of the newest bit, and of the current group's first bit
+  uint64_t last_sample_;
+  uint64_t group_start_sample_;
+  std::vector<bool> is_block_corrected_;
+  float block_error_rate_;
+  unsigned num_blocks_in_sync_;
+  // Reliability of each bit in wideblock_, newest first
+  std::deque<float> reliability_;
+  const bool use_soft_decoding_;
+  // Block A of pi_, with its check bits
+  uint32_t pi_block_;
+  // The last block was lost or corrected; look for the PI between block
+  // boundaries
+  bool is_flywheeling_;
+  // Length correction of the next block after a clock slip
+  int bit_slip_;
+  // Not applied on the RDS2 data streams, where block A isn't always a PI;
+  // GroupHandler filters those
+  const GroupFilter filter_;
+  // The current group's block A or B didn't pass the filter
+  bool is_group_filtered_;
+  const bool use_cycle_counter_;
+  SyncStats stats_;
 
 };
 
@@ -0,0 +1,221 @@
+#include "channelizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace redsea {
+
+namespace {
+
+const double kChannelSpacing = 200000.0;
+const float kChannelRate = 2 * kChannelSpacing;
+const float kMaxDeviation = 75000.0f;
+const float kMPXScale = 10000.0f;
+
+// Number of filterbank frames read at a time (~0.1 s at 2.4 MS/s, where a
+// frame is 6 samples)
+const int kFramesPerChunk = 40000;
+
+// A channel is considered occupied if its power is this many times above the
+// median of all channels (i.e. the noise floor)
+const float kOccupancyThreshold = 10.0f;
+
+// Frequency in MHz, for tagging the output
+std::string frequencyString(double freq) {
+  char buff[16];
+  snprintf(buff, sizeof(buff), "%.1f", freq / 1e6);
+  return std::string(buff);
+}
+
+}
+
+FMChannel::FMChannel(double frequency, const Options& options) :
+  fm_demod_(kMaxDeviation / kChannelRate),
+  resampler_(kMPXRate / kChannelRate), block_stream_(options),
+  group_handler_(options, "freq", frequencyString(frequency)),
+  groups_(), group_samples_(), is_skipping_(false) {
+
+    block_stream_.setLabel("freq " + frequencyString(frequency));
+
+}
+
+std::vector<int16_t> FMChannel::demodulate(
+    const std::vector<std::complex<float>>& samples) {
+
+  std::vector<float> demodulated(samples.size());
+  for (size_t i=0; i<samples.size(); i++)
+    demodulated[i] = fm_demod_.demodulate(samples[i]);
+
+  std::vector<float> resampled = resampler_.execute(demodulated);
+
+  std::vector<int16_t> mpx(resampled.size());
+  for (size_t i=0; i<resampled.size(); i++)
+    mpx[i] = std::max(-32767.0f, std::min(32767.0f,
+          resampled[i] * kMPXScale));
+
+  // Without RDS (-g), the channel is left out of the SubcarrierBank
+  if (!block_stream_.gate(mpx))
+    mpx.clear();
+
+  return mpx;
+}
+
+void FMChannel::decode(const std::vector<std::complex<float>>& baseband) {
+
+  is_skipping_ = false;
+  block_stream_.pushBaseband(baseband);
+  popGroups();
+}
+
+// A chunk of channel samples that isn't decoded, since the channel is not
+// occupied. The FM demodulator starts afresh when the channel comes back,
+// and the RDS decoder treats the chunk as a gap.
+void FMChannel::skip(size_t num_samples) {
+  if (!is_skipping_) {
+    fm_demod_.reset();
+    resampler_.reset();
+    is_skipping_ = true;
+  }
+  block_stream_.skipSamples(
+      std::llround(num_samples * kMPXRate / kChannelRate));
+}
+
+void FMChannel::popGroups() {
+  while (block_stream_.hasGroup()) {
+    GroupInfo info;
+    groups_.push_back(block_stream_.popGroup(&info));
+    group_samples_.push_back(info.start_sample);
+  }
+}
+
+// Called from the main thread so that output lines never interleave
+void FMChannel::printGroups() {
+  for (size_t i=0; i<groups_.size(); i++)
+    group_handler_.handle(groups_[i], group_samples_[i]);
+  groups_.clear();
+  group_samples_.clear();
+}
+
+// Flushes the last block and prints the demodulator's diagnostics (-e) and
+// the last snapshot (-S)
+void FMChannel::endInput() {
+  block_stream_.endInput();
+  popGroups();
+  printGroups();
+  group_handler_.endInput();
+}
+
+Channelizer::Channelizer(const Options& options) :
+  num_channels_(std::round(options.sample_rate / kChannelSpacing)),
+  filterbank_(num_channels_), channels_(num_channels_),
+  channel_samples_(num_channels_), channel_power_(num_channels_),
+  is_occupied_(num_channels_), subcarrier_bank_(num_channels_),
+  workers_() {
+
+  for (unsigned k=0; k<num_channels_; k++) {
+    int offset = (k <= num_channels_ / 2 ? k : int(k) - int(num_channels_));
+    channels_[k].reset(new FMChannel(options.center_freq +
+        offset * kChannelSpacing, options));
+  }
+
+}
+
+bool Channelizer::readChunk() {
+
+  const unsigned frame_length = num_channels_ / 2;
+
+  std::vector<uint8_t> buffer(2 * frame_length * kFramesPerChunk);
+  size_t bytesread = fread(buffer.data(), 1, buffer.size(), stdin);
+  if (bytesread < buffer.size())
+    return false;
+
+  for (unsigned k=0; k<num_channels_; k++) {
+    channel_samples_[k].clear();
+    channel_power_[k] = 0.0f;
+  }
+
+  std::vector<std::complex<float>> frame(frame_length);
+
+  for (int n=0; n<kFramesPerChunk; n++) {
+    for (unsigned i=0; i<frame_length; i++) {
+      size_t idx = 2 * (n * frame_length + i);
+      frame[i] = std::complex<float>((buffer[idx]   - 127.5f) / 127.5f,
+                                     (buffer[idx+1] - 127.5f) / 127.5f);
+    }
+
+    std::vector<std::complex<float>> out = filterbank_.execute(frame);
+
+    for (unsigned k=0; k<num_channels_; k++) {
+      channel_samples_[k].push_back(out[k]);
+      channel_power_[k] += std::norm(out[k]);
+    }
+  }
+
+  return true;
+}
+
+void Channelizer::updateOccupancy() {
+
+  std::vector<float> sorted_power(channel_power_);
+  std::sort(sorted_power.begin(), sorted_power.end());
+  float noise_floor = sorted_power[sorted_power.size() / 2];
+
+  for (unsigned k=0; k<num_channels_; k++) {
+    is_occupied_[k] = (channel_power_[k] > kOccupancyThreshold * noise_floor);
+  }
+
+  // The channel at the band edge is only partially inside the capture
+  is_occupied_[num_channels_ / 2] = false;
+
+}
+
+void Channelizer::forEachOccupiedChannel(std::function<void(unsigned)> func) {
+
+  std::vector<unsigned> occupied;
+  for (unsigned k=0; k<num_channels_; k++)
+    if (is_occupied_[k])
+      occupied.push_back(k);
+
+  workers_.run(occupied.size(), [&](unsigned i) {
+    func(occupied[i]);
+  });
+
+}
+
+void Channelizer::run() {
+
+  std::vector<std::vector<int16_t>> mpx(num_channels_);
+  std::vector<std::vector<std::complex<float>>> baseband;
+
+  while (readChunk()) {
+
+    updateOccupancy();
+
+    for (unsigned k=0; k<num_channels_; k++) {
+      mpx[k].clear();
+      if (!is_occupied_[k])
+        channels_[k]->skip(channel_samples_[k].size());
+    }
+
+    forEachOccupiedChannel([&](unsigned k) {
+      mpx[k] = channels_[k]->demodulate(channel_samples_[k]);
+    });
+
+    baseband = subcarrier_bank_.demodulate(mpx);
+
+    forEachOccupiedChannel([&](unsigned k) {
+      channels_[k]->decode(baseband[k]);
+    });
+
+    for (unsigned k=0; k<num_channels_; k++)
+      channels_[k]->printGroups();
+
+  }
+
+  for (std::unique_ptr<FMChannel>& channel : channels_)
+    channel->endInput();
+
+}
+
+} // namespace redsea
@@ -0,0 +1,66 @@
+#ifndef CHANNELIZER_H_
+#define CHANNELIZER_H_
+
+#include <complex>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "block_sync.h"
+#include "common.h"
+#include "groups.h"
+#include "liquid_wrappers.h"
+#include "worker_pool.h"
+
+namespace redsea {
+
+// One 200 kHz FM channel of a wideband capture, with its own RDS decoder
+class FMChannel {
+  public:
+    FMChannel(double frequency, const Options& options);
+    std::vector<int16_t> demodulate(
+        const std::vector<std::complex<float>>& samples);
+    void decode(const std::vector<std::complex<float>>& baseband);
+    void skip(size_t num_samples);
+    void printGroups();
+    void endInput();
+
+  private:
+    void popGroups();
+
+    liquid::FMDemod fm_demod_;
+    liquid::Resampler resampler_;
+    BlockStream block_stream_;
+    GroupHandler group_handler_;
+    std::vector<std::vector<uint16_t>> groups_;
+    // MPX sample of each group's first bit, for timestamps (-T)
+    std::vector<uint64_t> group_samples_;
+    // The last chunk wasn't decoded; the demodulator restarts on the next
+    bool is_skipping_;
+};
+
+// Splits an 8-bit IQ stream (as output by rtl_sdr) into FM channels and
+// decodes RDS on all occupied channels in parallel. The RDS subcarriers of
+// all channels are mixed down and filtered together in a SubcarrierBank.
+class Channelizer {
+  public:
+    Channelizer(const Options& options);
+    void run();
+
+  private:
+    bool readChunk();
+    void updateOccupancy();
+    void forEachOccupiedChannel(std::function<void(unsigned)> func);
+
+    const unsigned num_channels_;
+    liquid::PFBChannelizer filterbank_;
+    std::vector<std::unique_ptr<FMChannel>> channels_;
+    std::vector<std::vector<std::complex<float>>> channel_samples_;
+    std::vector<float> channel_power_;
+    std::vector<bool> is_occupied_;
+    SubcarrierBank subcarrier_bank_;
+    WorkerPool workers_;
+};
+
+} // namespace redsea
+#endif // CHANNELIZER_H_
@@ -0,0 +1,112 @@
+#ifndef COMMON_H_
+#define COMMON_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace redsea {
+
+// Of the MPX signal that the subcarriers are demodulated from
+const double kMPXRate = 228000.0;
+
+// MPX samples decoded at a time when streams are decoded in parallel
+// (~0.1 s)
+const size_t kMPXChunkSize = 22800;
+
+enum eInputType {
+  INPUT_MPX, INPUT_ASCIIBITS, INPUT_RDSSPY
+};
+
+enum eOutputType {
+  OUTPUT_HEX, OUTPUT_JSON
+};
+
+// Where the wall-clock time of group timestamps (-T) comes from
+enum eTimeBase {
+  TIME_NONE, TIME_START, TIME_CT
+};
+
+// Selective decoding: groups from other PIs (-p) or of other types (-t)
+// are dropped as soon as their block A or B is known. The types that other
+// groups need (2A/2B for the RadioText that RT+ points into, and 3A for the
+// ODA announcements, e.g. of TMC) are still decoded, but not output.
+struct GroupFilter {
+  GroupFilter() : pis(), type_mask(0xFFFFFFFF) {}
+  bool isSet() const {
+    return !pis.empty() || type_mask != 0xFFFFFFFF;
+  }
+  bool isWantedPI(uint16_t pi) const {
+    return pis.empty() || std::find(pis.begin(), pis.end(), pi) != pis.end();
+  }
+  // Takes block B
+  bool isWantedType(uint16_t block2) const {
+    return (type_mask >> (block2 >> 11)) & 1;
+  }
+  bool isDecodedType(uint16_t block2) const {
+    return ((type_mask | kStateTypes) >> (block2 >> 11)) & 1;
+  }
+  // Without block B the type is unknown, so such groups only pass when all
+  // types are wanted
+  bool isWanted(const std::vector<uint16_t>& blocks) const {
+    return !blocks.empty() && isWantedPI(blocks[0]) &&
+      (blocks.size() < 2 ? type_mask == 0xFFFFFFFF : isWantedType(blocks[1]));
+  }
+  bool isDecoded(const std::vector<uint16_t>& blocks) const {
+    return !blocks.empty() && isWantedPI(blocks[0]) &&
+      (blocks.size() < 2 ? type_mask == 0xFFFFFFFF :
+       isDecodedType(blocks[1]));
+  }
+  // Bits of 2A, 2B and 3A
+  static const uint32_t kStateTypes = (1 << 4) | (1 << 5) | (1 << 6);
+  // Empty for all PIs
+  std::vector<uint16_t> pis;
+  // Bit (type << 1 | version) for each wanted group type
+  uint32_t type_mask;
+};
+
+// Command line options
+struct Options {
+  Options() : input_type(INPUT_MPX), output_type(OUTPUT_JSON),
+    use_fixed_point(false), compare_fixed_point(false), use_pilot(false), use_rds_gate(false),
+    use_equalizer(false), use_rds2(false), is_wideband(false),
+    center_freq(0.0), sample_rate(2400000.0), scan_fd(-1),
+    use_diversity(false), control_path(), max_stations(256),
+    use_delta_output(false), snapshot_interval(0.0), filter(), fields(),
+    time_base(TIME_NONE), start_time(0.0), stats_path() {}
+  eInputType input_type;
+  eOutputType output_type;
+  bool use_fixed_point;
+  // Also run the float chain and count the bits where the two differ (-C)
+  bool compare_fixed_point;
+  bool use_pilot;
+  bool use_rds_gate;
+  bool use_equalizer;
+  bool use_rds2;
+  bool is_wideband;
+  double center_freq;
+  double sample_rate;
+  int scan_fd;
+  bool use_diversity;
+  // Daemon mode (-D) when set
+  std::string control_path;
+  // Stations kept per input before the least recently heard is evicted
+  int max_stations;
+  // Only write the fields that changed (-u)
+  bool use_delta_output;
+  // Seconds between station snapshots (-S), or 0
+  double snapshot_interval;
+  GroupFilter filter;
+  // JSON members to write (-f), or empty for all
+  std::vector<std::string> fields;
+  eTimeBase time_base;
+  // Seconds since the epoch at the first input sample, with TIME_START
+  double start_time;
+  // Counters (-M): "-" for stderr, or a Prometheus text file
+  std::string stats_path;
+};
+
+} // namespace redsea
+#endif // COMMON_H_
@@ -0,0 +1,494 @@
+#include "daemon.h"
+
+#ifdef HAVE_DAEMON
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace redsea {
+
+namespace {
+
+const size_t kReadSize = 65536;
+const int kMaxEvents = 64;
+
+// Chunks waiting per stream before it stops being read (~0.4 s)
+const unsigned kMaxQueuedJobs = 4;
+
+// Only removes a socket, in case the path was mistyped
+bool unlinkSocket(const std::string& path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0)
+    return errno == ENOENT;
+  if (!S_ISSOCK(st.st_mode))
+    return false;
+  return unlink(path.c_str()) == 0;
+}
+
+// The CPUs this process may run on
+std::vector<int> allowedCPUs() {
+  std::vector<int> result;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+    for (int cpu=0; cpu<CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &cpus))
+        result.push_back(cpu);
+  }
+  return result;
+}
+
+int addToEpoll(int epoll_fd, int fd) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int openUnixSocket(const std::string& path, bool is_listening) {
+  struct sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int result;
+  if (is_listening) {
+    if (!unlinkSocket(path)) {
+      close(fd);
+      return -1;
+    }
+    // Only the owner may control the daemon. The umask applies to the whole
+    // process, but this runs before the workers are started.
+    mode_t old_umask = umask(0177);
+    result = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_umask);
+    if (result == 0)
+      result = listen(fd, 8);
+  } else {
+    result = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    if (result != 0 && errno == EINPROGRESS)
+      result = 0;
+  }
+
+  if (result != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+}
+
+DaemonStream::DaemonStream(const std::string& _name, int _fd,
+    unsigned _worker, const Options& options) : name(_name), fd(_fd),
+  worker(_worker), pending(), num_queued(0), is_paused(false),
+  block_stream(options),
+  group_handler(options, "stream", _name) {
+
+}
+
+Daemon::Daemon(const Options& options) : options_(options),
+  start_time_(std::chrono::steady_clock::now()),
+  epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), control_fd_(-1),
+  wake_fd_(-1), control_clients_(), streams_(), streams_by_fd_(), closed_fds_(),
+  workers_(), next_worker_(0), output_mutex_(), is_running_(true) {
+
+  if (epoll_fd_ < 0)
+    throw std::runtime_error("epoll: " + std::string(strerror(errno)));
+
+  control_fd_ = openUnixSocket(options.control_path, true);
+  if (control_fd_ < 0) {
+    close(epoll_fd_);
+    throw std::runtime_error("can't listen on " + options.control_path +
+        " (or it exists and is not a socket)");
+  }
+
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0 || addToEpoll(epoll_fd_, control_fd_) != 0 ||
+      addToEpoll(epoll_fd_, wake_fd_) != 0) {
+    std::string error = strerror(errno);
+    if (wake_fd_ >= 0)
+      close(wake_fd_);
+    close(control_fd_);
+    unlinkSocket(options.control_path);
+    close(epoll_fd_);
+    throw std::runtime_error("epoll: " + error);
+  }
+
+  // One worker per CPU in the affinity mask, which need not start at 0 (e.g.
+  // under taskset or in a cpuset); unpinned if the mask can't be read
+  const std::vector<int> cpus = allowedCPUs();
+  const unsigned num_workers = (cpus.empty() ?
+      std::max(1u, std::thread::hardware_concurrency()) : cpus.size());
+  for (unsigned w=0; w<num_workers; w++)
+    workers_.push_back(new DaemonWorker());
+
+  for (unsigned w=0; w<num_workers; w++) {
+    workers_[w]->thread = std::thread(&Daemon::work, this, w);
+
+    if (cpus.empty())
+      continue;
+
+    cpu_set_t cpu;
+    CPU_ZERO(&cpu);
+    CPU_SET(cpus[w], &cpu);
+    int result = pthread_setaffinity_np(workers_[w]->thread.native_handle(),
+        sizeof(cpu), &cpu);
+    if (result != 0)
+      fprintf(stderr, "can't pin worker %u to CPU %d: %s\n", w, cpus[w],
+          strerror(result));
+  }
+
+}
+
+Daemon::~Daemon() {
+
+  while (!streams_.empty())
+    removeStream(streams_.begin()->first);
+
+  // An empty job without a stream stops the worker
+  for (DaemonWorker* worker : workers_) {
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      worker->jobs.push_back(DaemonJob());
+    }
+    worker->has_jobs.notify_one();
+  }
+
+  for (DaemonWorker* worker : workers_) {
+    worker->thread.join();
+    delete worker;
+  }
+
+  for (auto& client : control_clients_)
+    close(client.first);
+  close(control_fd_);
+  unlinkSocket(options_.control_path);
+  close(wake_fd_);
+  close(epoll_fd_);
+
+}
+
+// FIFOs are opened for writing too, so that they stay open when the
+// process feeding them is restarted
+bool Daemon::addStream(const std::string& name, const std::string& path,
+    std::string* error) {
+
+  if (streams_.count(name) > 0) {
+    *error = "stream " + name + " exists";
+    return false;
+  }
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    *error = "can't open " + path;
+    return false;
+  }
+
+  int fd = -1;
+  if (S_ISFIFO(st.st_mode))
+    fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  else if (S_ISSOCK(st.st_mode))
+    fd = openUnixSocket(path, false);
+  else {
+    *error = path + " is not a FIFO or a socket";
+    return false;
+  }
+
+  if (fd < 0) {
+    *error = "can't open " + path;
+    return false;
+  }
+
+  if (addToEpoll(epoll_fd_, fd) != 0) {
+    *error = "epoll: " + std::string(strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  // Sample 0 of the stream is now, which is -T TIME plus the time since the
+  // daemon started
+  Options stream_options = options_;
+  stream_options.start_time += std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time_).count();
+
+  std::shared_ptr<DaemonStream> stream = std::make_shared<DaemonStream>(name,
+      fd, next_worker_, stream_options);
+  next_worker_ = (next_worker_ + 1) % workers_.size();
+
+  streams_[name] = stream;
+  streams_by_fd_[fd] = stream;
+
+  return true;
+}
+
+// The stream's last groups are output by its worker
+bool Daemon::removeStream(const std::string& name) {
+
+  if (streams_.count(name) == 0)
+    return false;
+
+  std::shared_ptr<DaemonStream> stream = streams_[name];
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, stream->fd, nullptr);
+  close(stream->fd);
+  closed_fds_.insert(stream->fd);
+  streams_by_fd_.erase(stream->fd);
+  streams_.erase(name);
+
+  DaemonJob rest;
+  rest.stream = stream;
+  rest.samples.resize(stream->pending.size() / sizeof(int16_t));
+  memcpy(rest.samples.data(), stream->pending.data(),
+      rest.samples.size() * sizeof(int16_t));
+  if (!rest.samples.empty())
+    post(rest);
+
+  DaemonJob end;
+  end.stream = stream;
+  post(end);
+
+  return true;
+}
+
+void Daemon::run() {
+
+  struct epoll_event events[kMaxEvents];
+
+  while (is_running_) {
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (num_events < 0 && errno != EINTR)
+      break;
+
+    // An fd closed while handling this batch may already have been reused
+    // (e.g. by an add), so its remaining events are stale
+    closed_fds_.clear();
+
+    for (int n=0; n<num_events && is_running_; n++) {
+      int fd = events[n].data.fd;
+
+      if (closed_fds_.count(fd) > 0)
+        continue;
+      else if (fd == control_fd_)
+        acceptControl();
+      else if (fd == wake_fd_)
+        resumeStreams();
+      else if (control_clients_.count(fd) > 0)
+        readControl(fd);
+      else if (streams_by_fd_.count(fd) > 0)
+        readStream(streams_by_fd_[fd]);
+    }
+  }
+
+}
+
+void Daemon::acceptControl() {
+  int fd = accept4(control_fd_, nullptr, nullptr,
+      SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  if (addToEpoll(epoll_fd_, fd) != 0) {
+    close(fd);
+    return;
+  }
+  control_clients_[fd] = "";
+}
+
+void Daemon::readControl(int fd) {
+
+  char buffer[1024];
+  ssize_t bytesread;
+  while ((bytesread = read(fd, buffer, sizeof(buffer))) > 0)
+    control_clients_[fd].append(buffer, bytesread);
+
+  std::string& lines = control_clients_[fd];
+  size_t newline;
+  while ((newline = lines.find('\n')) != std::string::npos) {
+    std::string reply = command(lines.substr(0, newline)) + "\n";
+    lines.erase(0, newline + 1);
+    if (send(fd, reply.c_str(), reply.size(), MSG_NOSIGNAL) < 0)
+      break;
+  }
+
+  if (bytesread == 0 || (bytesread < 0 && errno != EAGAIN)) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    closed_fds_.insert(fd);
+    control_clients_.erase(fd);
+  }
+
+}
+
+// Returns the reply
+std::string Daemon::command(const std::string& line) {
+
+  std::istringstream words(line);
+  std::string verb, name, path;
+  words >> verb >> name >> path;
+
+  if (verb == "add" && !name.empty() && !path.empty()) {
+    std::string error;
+    return addStream(name, path, &error) ? "ok" : "error: " + error;
+
+  } else if (verb == "remove" && !name.empty()) {
+    return removeStream(name) ? "ok" : "error: no stream " + name;
+
+  } else if (verb == "list") {
+    std::string result;
+    for (auto& stream : streams_)
+      result += stream.first + " ";
+    return result + "ok";
+
+  } else if (verb == "quit") {
+    is_running_ = false;
+    return "ok";
+  }
+
+  return "error: unknown command";
+
+}
+
+// One read per event, so that a busy stream can't starve the others (epoll
+// reports it again if there's more); a socket that was closed by the other
+// end is removed
+void Daemon::readStream(std::shared_ptr<DaemonStream> stream) {
+
+  char buffer[kReadSize];
+  ssize_t bytesread = read(stream->fd, buffer, sizeof(buffer));
+  if (bytesread > 0)
+    stream->pending.append(buffer, bytesread);
+
+  if (bytesread == 0 || (bytesread < 0 && errno != EAGAIN &&
+                         errno != EINTR)) {
+    fprintf(stderr, "stream %s closed\n", stream->name.c_str());
+    removeStream(stream->name);
+    return;
+  }
+
+  postChunks(stream);
+
+}
+
+// Whole chunks are sent to the worker until its queue for the stream is
+// full; then the stream is taken out of epoll (rather than only EPOLLIN, as
+// a hangup would still be reported) until resumeStreams()
+void Daemon::postChunks(std::shared_ptr<DaemonStream> stream) {
+
+  const size_t chunk_bytes = kMPXChunkSize * sizeof(int16_t);
+  size_t offset = 0;
+  while (stream->pending.size() - offset >= chunk_bytes &&
+         stream->num_queued < kMaxQueuedJobs) {
+    DaemonJob job;
+    job.stream = stream;
+    job.samples.resize(kMPXChunkSize);
+    memcpy(job.samples.data(), stream->pending.data() + offset, chunk_bytes);
+    offset += chunk_bytes;
+    post(job);
+  }
+  stream->pending.erase(0, offset);
+
+  const bool is_full = (stream->num_queued >= kMaxQueuedJobs);
+  if (is_full && !stream->is_paused)
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, stream->fd, nullptr);
+  else if (!is_full && stream->is_paused)
+    addToEpoll(epoll_fd_, stream->fd);
+  stream->is_paused = is_full;
+
+}
+
+void Daemon::resumeStreams() {
+
+  // Resets the counter
+  uint64_t count;
+  if (read(wake_fd_, &count, sizeof(count)) < 0)
+    return;
+
+  for (auto& stream : streams_)
+    if (stream.second->is_paused)
+      postChunks(stream.second);
+
+}
+
+void Daemon::post(DaemonJob job) {
+  DaemonWorker* worker = workers_[job.stream->worker];
+  job.stream->num_queued ++;
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->jobs.push_back(job);
+  }
+  worker->has_jobs.notify_one();
+}
+
+void Daemon::work(unsigned w) {
+
+  DaemonWorker* worker = workers_[w];
+
+  while (true) {
+    DaemonJob job;
+    {
+      std::unique_lock<std::mutex> lock(worker->mutex);
+      worker->has_jobs.wait(lock, [worker]() {
+        return !worker->jobs.empty();
+      });
+      job = worker->jobs.front();
+      worker->jobs.pop_front();
+    }
+
+    if (!job.stream)
+      break;
+
+    BlockStream& block_stream = job.stream->block_stream;
+    const bool is_end = job.samples.empty();
+    if (is_end)
+      block_stream.endInput();
+    else
+      block_stream.pushSamples(job.samples);
+
+    // Lines from different streams must not interleave
+    if (block_stream.hasGroup() || is_end) {
+      std::lock_guard<std::mutex> lock(output_mutex_);
+      while (block_stream.hasGroup()) {
+        GroupInfo info;
+        std::vector<uint16_t> group = block_stream.popGroup(&info);
+        job.stream->group_handler.handle(group, info.start_sample);
+      }
+      // The last snapshot (-S)
+      if (is_end)
+        job.stream->group_handler.endInput();
+      fflush(stdout);
+    }
+
+    // Only fails if the counter would overflow, when it's set anyway
+    if (job.stream->num_queued-- == kMaxQueuedJobs) {
+      uint64_t one = 1;
+      ssize_t result = write(wake_fd_, &one, sizeof(one));
+      (void)result;
+    }
+  }
+
+}
+
+} // namespace redsea
+
+#endif // HAVE_DAEMON
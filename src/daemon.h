@@ -0,0 +1,108 @@
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#if defined(__linux__)
+#define HAVE_DAEMON
+#endif
+
+#ifdef HAVE_DAEMON
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_sync.h"
+#include "common.h"
+#include "groups.h"
+
+namespace redsea {
+
+// One MPX input of the daemon, with its own decoder chain
+struct DaemonStream {
+  DaemonStream(const std::string& name, int fd, unsigned worker,
+      const Options& options);
+  const std::string name;
+  const int fd;
+  const unsigned worker;
+  // Input bytes not yet sent to the worker
+  std::string pending;
+  // Jobs posted to the worker and not yet decoded
+  std::atomic<unsigned> num_queued;
+  // Not read from while its worker is behind
+  bool is_paused;
+  BlockStream block_stream;
+  GroupHandler group_handler;
+};
+
+// Samples for a stream's decoder; an empty job ends the stream
+struct DaemonJob {
+  std::shared_ptr<DaemonStream> stream;
+  std::vector<int16_t> samples;
+};
+
+struct DaemonWorker {
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable has_jobs;
+  std::deque<DaemonJob> jobs;
+};
+
+// Decodes many MPX streams (FIFOs or UNIX sockets) in one process. The
+// inputs are multiplexed with epoll; decoding runs on a fixed pool of
+// workers, one pinned to each allowed CPU, and each stream always goes to the same
+// worker so that its chain is only used by one thread. A stream whose worker
+// falls behind is not read until its queue drains. Streams can be added
+// and removed at runtime over the control socket, one command per line:
+//   add NAME PATH
+//   remove NAME
+//   list
+//   quit
+class Daemon {
+  public:
+    Daemon(const Options& options);
+    ~Daemon();
+    bool addStream(const std::string& name, const std::string& path,
+        std::string* error);
+    void run();
+
+  private:
+    bool removeStream(const std::string& name);
+    void acceptControl();
+    void readControl(int fd);
+    std::string command(const std::string& line);
+    void readStream(std::shared_ptr<DaemonStream> stream);
+    void postChunks(std::shared_ptr<DaemonStream> stream);
+    void resumeStreams();
+    void post(DaemonJob job);
+    void work(unsigned w);
+
+    const Options options_;
+    // For the start time (-T) of streams added later
+    const std::chrono::steady_clock::time_point start_time_;
+    int epoll_fd_;
+    int control_fd_;
+    // Written by a worker when a full queue drains
+    int wake_fd_;
+    std::map<int, std::string> control_clients_;
+    std::map<std::string, std::shared_ptr<DaemonStream>> streams_;
+    std::map<int, std::shared_ptr<DaemonStream>> streams_by_fd_;
+    // Closed during the current batch of events
+    std::set<int> closed_fds_;
+    std::vector<DaemonWorker*> workers_;
+    unsigned next_worker_;
+    std::mutex output_mutex_;
+    bool is_running_;
+};
+
+} // namespace redsea
+
+#endif // HAVE_DAEMON
+#endif // DAEMON_H_
@@ -0,0 +1,153 @@
+#include "decoder.h"
+
+#include "block_sync.h"
+#include "groups.h"
+#include "stats.h"
+
+namespace redsea {
+
+Decoder::Decoder(const Options& options, const DecoderCallbacks& callbacks) :
+  options_(options), callbacks_(callbacks), sample_stream_(), bit_stream_(),
+  group_handler_(), stats_writer_(), pi_(0), ps_(), rt_(), pty_(-1) {
+
+  Options mpx_options = options;
+  mpx_options.input_type = INPUT_MPX;
+  sample_stream_.reset(new BlockStream(mpx_options));
+  // Nothing goes to stderr, even without the callbacks
+  sample_stream_->setRDSRangeHandler(callbacks.on_rds_range ?
+      callbacks.on_rds_range : [](double, double) {});
+  sample_stream_->setDiagnosticHandler(callbacks.on_diagnostic ?
+      callbacks.on_diagnostic : [](const std::string&) {});
+
+  Options json_options = options;
+  json_options.output_type = OUTPUT_JSON;
+  group_handler_.reset(new GroupHandler(json_options));
+  group_handler_->setDiagnosticHandler(callbacks.on_diagnostic ?
+      callbacks.on_diagnostic : [](const std::string&) {});
+  // Snapshots (-S) are lines like any other, but only in JSON output
+  group_handler_->setSnapshotHandler([this](const std::string& json) {
+    if (options_.output_type == OUTPUT_JSON && callbacks_.on_line)
+      callbacks_.on_line(json);
+  });
+
+  if (!options.stats_path.empty())
+    stats_writer_.reset(new StatsWriter(options.stats_path));
+
+}
+
+// Defined here, where the owned classes are complete
+Decoder::~Decoder() {
+
+}
+
+void Decoder::pushSamples(const std::vector<int16_t>& samples) {
+  sample_stream_->pushSamples(samples);
+  popGroups(sample_stream_.get());
+  updateStats();
+}
+
+// Hard bits, without the soft decoding and the subcarrier's sync tracking
+void Decoder::pushBits(const std::vector<bool>& bits) {
+  if (!bit_stream_) {
+    Options bit_options = options_;
+    bit_options.input_type = INPUT_ASCIIBITS;
+    bit_stream_.reset(new BlockStream(bit_options));
+  }
+
+  for (bool bit : bits)
+    bit_stream_->pushBit({bit, 1.0f, 0});
+  popGroups(bit_stream_.get());
+  updateStats();
+}
+
+// Snapshot time (-S) is counted in groups, as nothing else is known of the
+// input
+void Decoder::pushGroup(const std::vector<uint16_t>& blocks,
+    int64_t sample) {
+  decodeGroup(blocks, sample);
+  if (!blocks.empty())
+    group_handler_->countGroup();
+}
+
+void Decoder::decodeGroup(const std::vector<uint16_t>& blocks,
+    int64_t sample) {
+
+  if (callbacks_.on_group)
+    callbacks_.on_group(blocks);
+
+  // The hex line is made here, so the Station is updated for the typed
+  // callbacks in either output mode
+  std::string line;
+  if (!group_handler_->decode(blocks, &line, sample))
+    return;
+
+  if (options_.output_type == OUTPUT_HEX)
+    line = Group(blocks).toHex();
+  if (callbacks_.on_line && !line.empty())
+    callbacks_.on_line(line);
+
+  const Station& station = group_handler_->getStation();
+
+  if (station.getPI() != pi_) {
+    pi_ = station.getPI();
+    ps_.clear();
+    rt_.clear();
+    pty_ = -1;
+    if (callbacks_.on_pi)
+      callbacks_.on_pi(pi_);
+  }
+
+  if (station.hasPS() && station.getPS() != ps_) {
+    ps_ = station.getPS();
+    if (callbacks_.on_ps)
+      callbacks_.on_ps(pi_, ps_);
+  }
+
+  if (station.hasRT() && station.getRT() != rt_) {
+    rt_ = station.getRT();
+    if (callbacks_.on_radiotext)
+      callbacks_.on_radiotext(pi_, rt_);
+  }
+
+  if (blocks.size() > 1 && station.getPTY() != pty_) {
+    pty_ = station.getPTY();
+    if (callbacks_.on_pty)
+      callbacks_.on_pty(pi_, pty_);
+  }
+
+}
+
+void Decoder::endInput() {
+  sample_stream_->endInput();
+  popGroups(sample_stream_.get());
+  if (bit_stream_) {
+    bit_stream_->endInput();
+    popGroups(bit_stream_.get());
+  }
+  // The last snapshots (-S)
+  group_handler_->endInput();
+  updateStats(true);
+}
+
+// The counters of the block sync that was pushed to
+void Decoder::updateStats(bool is_final) {
+  if (!stats_writer_)
+    return;
+
+  const BlockStream& block_stream = (bit_stream_ ? *bit_stream_ :
+                                     *sample_stream_);
+  stats_writer_->update(block_stream.getDemodStats(),
+      block_stream.getSyncStats(), group_handler_->getStats(), is_final);
+}
+
+// Snapshots (-S) are timed by the input, as on the command line
+void Decoder::popGroups(BlockStream* block_stream) {
+  while (block_stream->hasGroup()) {
+    GroupInfo info;
+    std::vector<uint16_t> group = block_stream->popGroup(&info);
+    decodeGroup(group, info.start_sample);
+  }
+  group_handler_->updateClock(block_stream->getTime());
+}
+
+} // namespace redsea
@@ -0,0 +1,79 @@
+#ifndef DECODER_H_
+#define DECODER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace redsea {
+
+class BlockStream;
+class GroupHandler;
+class StatsWriter;
+
+// Called by Decoder as data is decoded. Unset callbacks are skipped.
+struct DecoderCallbacks {
+  // Every group, before the PI check; missing blocks are left out
+  std::function<void(const std::vector<uint16_t>& blocks)> on_group;
+  // The JSON line (or hex line with OUTPUT_HEX) redsea would print; with
+  // options.snapshot_interval, the snapshots
+  std::function<void(const std::string& line)> on_line;
+  // The fields below fire when their value changes
+  std::function<void(uint16_t pi)> on_pi;
+  std::function<void(uint16_t pi, const std::string& ps)> on_ps;
+  std::function<void(uint16_t pi, const std::string& rt)> on_radiotext;
+  std::function<void(uint16_t pi, int pty)> on_pty;
+  // Each stretch of input in which the RDS detector (options.use_rds_gate)
+  // found RDS, in seconds from the first sample
+  std::function<void(double start, double end)> on_rds_range;
+  // Each line of the summaries that the command line prints on stderr at the
+  // end of input (options.use_equalizer, options.compare_fixed_point, and
+  // stations evicted for options.max_stations)
+  std::function<void(const std::string& line)> on_diagnostic;
+};
+
+// The decoder for embedding redsea in other programs: the caller pushes MPX
+// samples (at 228 kHz), bits or groups, and decoded data comes back through
+// the callbacks, on the pushing thread. Samples and bits go to block syncs of
+// their own, whatever options.input_type says. With options.stats_path, the
+// counters are written as with -M. Instances share no mutable state, so
+// different instances can be used from different threads at the same time.
+class Decoder {
+  public:
+    Decoder(const Options& options, const DecoderCallbacks& callbacks);
+    ~Decoder();
+    Decoder(const Decoder&) = delete;
+    Decoder& operator=(const Decoder&) = delete;
+
+    void pushSamples(const std::vector<int16_t>& samples);
+    void pushBits(const std::vector<bool>& bits);
+    // The sample is the input sample index of the group's first bit, or -1;
+    // it gives the group a timestamp with options.time_base
+    void pushGroup(const std::vector<uint16_t>& blocks, int64_t sample=-1);
+    // Flushes the last group
+    void endInput();
+
+  private:
+    void decodeGroup(const std::vector<uint16_t>& blocks, int64_t sample);
+    void popGroups(BlockStream* block_stream);
+    void updateStats(bool is_final=false);
+
+    const Options options_;
+    DecoderCallbacks callbacks_;
+    std::unique_ptr<BlockStream> sample_stream_;
+    // Created on the first pushBits
+    std::unique_ptr<BlockStream> bit_stream_;
+    std::unique_ptr<GroupHandler> group_handler_;
+    std::unique_ptr<StatsWriter> stats_writer_;
+    uint16_t pi_;
+    std::string ps_;
+    std::string rt_;
+    int pty_;
+};
+
+} // namespace redsea
+#endif // DECODER_H_
@@ -0,0 +1,162 @@
+#include "delta.h"
+
+#include <set>
+
+namespace redsea {
+
+namespace {
+
+const int kKeyframeInterval = 1000;
+
+// What keyframes repeat: the station's state, but not events (a TMC message,
+// a programme item starting, a clock time) that would look as if they had
+// just happened again. ODA announcements are all qualified with their group.
+bool isStateField(const std::string& key) {
+  static const std::set<std::string> state_fields = {
+    "ps", "radiotext", "prog_type", "tp", "ta", "alt_freqs", "ecc",
+    "country", "language", "tmc_id", "ews", "tmc.system_info",
+    "tmc.encryption_info", "tmc.service_provider"
+  };
+  return state_fields.count(key) > 0 || key.find("open_data_app.") == 0;
+}
+
+// The text after the key, or empty if there is none
+std::string memberValue(const std::string& member) {
+  size_t colon = member.find(':', memberKey(member).size() + 2);
+  return (colon == std::string::npos ? "" : member.substr(colon + 1));
+}
+
+// The key under which a member's last value is kept. For an object it is
+// qualified with the first member's key, e.g. "tmc.system_info"; an ODA
+// announcement is qualified with its group ("open_data_app.\"8A\""), since
+// they all start with that.
+std::string fieldKey(const std::string& member) {
+  std::string key = memberKey(member);
+  std::string value = memberValue(member);
+  if (value.size() < 2 || value[0] != '{')
+    return key;
+
+  std::vector<std::string> inner = splitMembers(value.substr(1,
+        value.size() - 2));
+  if (inner.empty())
+    return key;
+
+  std::string inner_key = memberKey(inner[0]);
+  if (inner_key == "oda_group")
+    return key + "." + memberValue(inner[0]);
+  return key + "." + inner_key;
+}
+
+}
+
+std::vector<std::string> splitMembers(const std::string& body) {
+  std::vector<std::string> members;
+  int depth = 0;
+  bool is_in_string = false;
+  std::string member;
+
+  for (size_t i=0; i<body.size(); i++) {
+    char c = body[i];
+
+    if (is_in_string) {
+      member += c;
+      if (c == '\\' && i+1 < body.size())
+        member += body[++i];
+      else if (c == '"')
+        is_in_string = false;
+      continue;
+    }
+
+    // Comments are kept inside values
+    if (c == '/' && i+1 < body.size() && body[i+1] == '*') {
+      size_t end = body.find("*/", i + 2);
+      end = (end == std::string::npos ? body.size() : end + 2);
+      if (depth > 0)
+        member += body.substr(i, end - i);
+      i = end - 1;
+      continue;
+    }
+
+    if (c == '"') {
+      is_in_string = true;
+    } else if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      depth--;
+    } else if (depth == 0 && (c == ',' || c == ' ')) {
+      if (c == ',' && !member.empty()) {
+        members.push_back(member);
+        member.clear();
+      }
+      continue;
+    }
+
+    member += c;
+  }
+
+  if (!member.empty())
+    members.push_back(member);
+
+  return members;
+}
+
+std::string memberKey(const std::string& member) {
+  size_t open = member.find('"');
+  size_t close = (open == std::string::npos ? open :
+                  member.find('"', open + 1));
+  if (close == std::string::npos)
+    return member;
+  return member.substr(open + 1, close - open - 1);
+}
+
+DeltaEncoder::DeltaEncoder() : fields_(), groups_since_keyframe_(0) {
+
+}
+
+bool DeltaEncoder::encode(const std::string& head, const std::string& body,
+    std::string* line) {
+
+  std::string changed;
+
+  for (const std::string& member : splitMembers(body)) {
+    std::string key = fieldKey(member);
+
+    // The group type is not station state
+    if (key == "group")
+      continue;
+
+    size_t i = 0;
+    while (i < fields_.size() && fields_[i].first != key)
+      i++;
+
+    if (i == fields_.size()) {
+      fields_.push_back({key, member});
+    } else if (fields_[i].second != member) {
+      fields_[i].second = member;
+    } else {
+      continue;
+    }
+
+    changed += "," + member;
+  }
+
+  bool is_keyframe = (groups_since_keyframe_ == 0);
+  groups_since_keyframe_ = (groups_since_keyframe_ + 1) % kKeyframeInterval;
+
+  if (is_keyframe) {
+    *line = head;
+    for (const auto& field : fields_)
+      if (isStateField(field.first))
+        *line += "," + field.second;
+    *line += ",\"keyframe\":\"true\"}\n";
+    return true;
+  }
+
+  if (changed.empty())
+    return false;
+
+  *line = head + changed + "}\n";
+  return true;
+}
+
+} // namespace redsea
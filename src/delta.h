@@ -0,0 +1,39 @@
+#ifndef DELTA_H_
+#define DELTA_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace redsea {
+
+// Splits ",\"a\":1,\"b\":{\"c\":2}" into its top-level members. Strings and
+// nested objects and arrays are skipped over; /* comments */ and whitespace
+// between the members are dropped, so that they don't stick to a member.
+std::vector<std::string> splitMembers(const std::string& body);
+// The key of "\"key\":value", or the whole text if it has none
+std::string memberKey(const std::string& member);
+
+// Change-only output (-u) for one station. Each JSON line is cut down to the
+// members whose value differs from the one last written; lines with nothing
+// new are dropped. Every kKeyframeInterval groups, the station's state (not
+// events such as TMC messages) is written again as a keyframe. Objects that
+// carry different things under one key (e.g. "tmc", or "open_data_app" for
+// each ODA) are told apart by their first member.
+class DeltaEncoder {
+  public:
+    DeltaEncoder();
+    // head is the opening of the line ('{' and the identifying members) and
+    // body the rest of its members, each starting with a comma. Returns
+    // false if nothing changed.
+    bool encode(const std::string& head, const std::string& body,
+        std::string* line);
+
+  private:
+    // Key and member text of each field, in the order first seen
+    std::vector<std::pair<std::string, std::string>> fields_;
+    int groups_since_keyframe_;
+};
+
+} // namespace redsea
+#endif // DELTA_H_
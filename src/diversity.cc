@@ -0,0 +1,179 @@
+#include "diversity.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace redsea {
+
+namespace {
+
+const unsigned kBitsPerGroup = 104;
+
+// Copies starting less than half a group apart are the same group. Inputs
+// may run this many groups apart before a group is output.
+const unsigned kMaxCopyDistance = kBitsPerGroup / 2;
+const unsigned kMaxInputLag = 3 * kBitsPerGroup;
+
+}
+
+DiversityCombiner::DiversityCombiner(const Options& options,
+    const std::vector<std::string>& paths) : inputs_(),
+  block_streams_(), groups_(paths.size()), group_info_(paths.size()),
+  pending_(), latest_start_bit_(0), group_handler_(options),
+  num_groups_in_(0), num_groups_out_(0), workers_(paths.size()) {
+
+  for (const std::string& path : paths) {
+    FILE* input = fopen(path.c_str(), "rb");
+    if (input == nullptr) {
+      for (FILE* f : inputs_)
+        fclose(f);
+      throw std::runtime_error("can't open " + path);
+    }
+    inputs_.push_back(input);
+    block_streams_.push_back(new BlockStream(options));
+  }
+
+}
+
+DiversityCombiner::~DiversityCombiner() {
+  for (FILE* input : inputs_)
+    fclose(input);
+  for (BlockStream* block_stream : block_streams_)
+    delete block_stream;
+}
+
+void DiversityCombiner::run() {
+
+  std::vector<bool> is_eof(inputs_.size());
+  std::vector<size_t> samplesread(inputs_.size());
+  bool is_any_open = true;
+
+  while (is_any_open) {
+
+    std::vector<size_t> open_inputs;
+    for (size_t i=0; i<inputs_.size(); i++)
+      if (!is_eof[i])
+        open_inputs.push_back(i);
+
+    workers_.run(open_inputs.size(),
+        [this, &open_inputs, &samplesread](unsigned n) {
+      const size_t i = open_inputs[n];
+      std::vector<int16_t> mpx(kMPXChunkSize);
+      samplesread[i] = fread(mpx.data(), sizeof(mpx[0]), mpx.size(),
+          inputs_[i]);
+      mpx.resize(samplesread[i]);
+
+      block_streams_[i]->pushSamples(mpx);
+      if (samplesread[i] < kMPXChunkSize)
+        block_streams_[i]->endInput();
+      while (block_streams_[i]->hasGroup()) {
+        GroupInfo info;
+        groups_[i].push_back(block_streams_[i]->popGroup(&info));
+        group_info_[i].push_back(info);
+      }
+    });
+
+    is_any_open = false;
+    for (size_t i=0; i<inputs_.size(); i++) {
+      for (size_t g=0; g<groups_[i].size(); g++)
+        add(groups_[i][g], group_info_[i][g]);
+      groups_[i].clear();
+      group_info_[i].clear();
+      if (samplesread[i] < kMPXChunkSize)
+        is_eof[i] = true;
+      is_any_open |= !is_eof[i];
+    }
+
+    if (latest_start_bit_ > kMaxInputLag)
+      flush(latest_start_bit_ - kMaxInputLag);
+
+  }
+
+  flush(latest_start_bit_ + 1);
+  group_handler_.endInput();
+
+  fprintf(stderr, "diversity: %llu groups from %zu inputs combined into "
+      "%llu\n", num_groups_in_, inputs_.size(), num_groups_out_);
+
+}
+
+void DiversityCombiner::add(const std::vector<uint16_t>& group,
+    const GroupInfo& info) {
+
+  num_groups_in_ ++;
+  latest_start_bit_ = std::max(latest_start_bit_, info.start_bit);
+
+  // The nearest group, not the PI, since block A may be miscorrected
+  GroupCopies* nearest = nullptr;
+  uint64_t nearest_distance = kMaxCopyDistance;
+  for (GroupCopies& copies : pending_) {
+    uint64_t distance = (copies.start_bit > info.start_bit ?
+        copies.start_bit - info.start_bit : info.start_bit - copies.start_bit);
+    if (distance < nearest_distance) {
+      nearest = &copies;
+      nearest_distance = distance;
+    }
+  }
+
+  if (nearest != nullptr) {
+    nearest->blocks.push_back(group);
+    nearest->is_corrected.push_back(info.is_corrected);
+    return;
+  }
+
+  // Kept in order of position
+  auto it = pending_.begin();
+  while (it != pending_.end() && it->start_bit <= info.start_bit)
+    ++it;
+  pending_.insert(it, {info.start_bit, info.start_sample, {group},
+      {info.is_corrected}});
+
+}
+
+// Outputs the groups that started before the given bit
+void DiversityCombiner::flush(uint64_t before_bit) {
+  while (!pending_.empty() && pending_.front().start_bit < before_bit) {
+    group_handler_.handle(combine(pending_.front()),
+        pending_.front().start_sample);
+    pending_.pop_front();
+    num_groups_out_ ++;
+  }
+}
+
+// Block by block; the group ends at the first block that no copy has
+std::vector<uint16_t> DiversityCombiner::combine(
+    const GroupCopies& copies) const {
+
+  std::vector<uint16_t> result;
+
+  for (size_t n=0; n<4; n++) {
+
+    // Error-free copies, corrected copies
+    std::map<uint16_t, std::pair<int,int>> votes;
+    for (size_t c=0; c<copies.blocks.size(); c++) {
+      if (copies.blocks[c].size() <= n)
+        continue;
+      if (copies.is_corrected[c][n])
+        votes[copies.blocks[c][n]].second ++;
+      else
+        votes[copies.blocks[c][n]].first ++;
+    }
+
+    if (votes.empty())
+      break;
+
+    auto best = votes.begin();
+    for (auto it = votes.begin(); it != votes.end(); ++it)
+      if (it->second > best->second)
+        best = it;
+
+    result.push_back(best->first);
+  }
+
+  return result;
+
+}
+
+} // namespace redsea
@@ -0,0 +1,56 @@
+#ifndef DIVERSITY_H_
+#define DIVERSITY_H_
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "block_sync.h"
+#include "common.h"
+#include "groups.h"
+#include "worker_pool.h"
+
+namespace redsea {
+
+// The copies of one group, as received by the different inputs
+struct GroupCopies {
+  uint64_t start_bit;
+  // Of the first copy, for timestamps (-T); the inputs start together
+  uint64_t start_sample;
+  std::vector<std::vector<uint16_t>> blocks;
+  std::vector<std::vector<bool>> is_corrected;
+};
+
+// Decodes several MPX recordings of the same station (e.g. from different
+// antennas) in parallel and merges their groups into one stream. Copies of
+// a group are matched by their position in the input only, which assumes
+// the recordings start at the same time; so a miscorrected PI is outvoted
+// like any other block. For each block, error-free copies are preferred over
+// corrected ones; within each kind the majority wins.
+class DiversityCombiner {
+  public:
+    DiversityCombiner(const Options& options,
+        const std::vector<std::string>& paths);
+    ~DiversityCombiner();
+    void run();
+
+  private:
+    void add(const std::vector<uint16_t>& group, const GroupInfo& info);
+    void flush(uint64_t before_bit);
+    std::vector<uint16_t> combine(const GroupCopies& copies) const;
+
+    std::vector<FILE*> inputs_;
+    std::vector<BlockStream*> block_streams_;
+    std::vector<std::vector<std::vector<uint16_t>>> groups_;
+    std::vector<std::vector<GroupInfo>> group_info_;
+    std::deque<GroupCopies> pending_;
+    uint64_t latest_start_bit_;
+    GroupHandler group_handler_;
+    unsigned long long num_groups_in_;
+    unsigned long long num_groups_out_;
+    WorkerPool workers_;
+};
+
+} // namespace redsea
+#endif // DIVERSITY_H_
@@ -0,0 +1,508 @@
+#include "dsp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#include "liquid/liquid.h"
+
+namespace redsea {
+namespace dsp {
+
+namespace {
+
+// Kernels. x and h are interleaved complex and real-duplicated-to-complex
+// arrays of n floats; the result is the complex dot product.
+typedef std::complex<float> (*DotProductFunc)(const float* x, const float* h,
+    int n);
+
+// Mix n samples down by a phasor that starts at -phase and advances by
+// -frequency radians per sample
+typedef void (*MixFunc)(const std::complex<float>* x, std::complex<float>* y,
+    int n, float phase, float frequency);
+
+std::complex<float> dotProductScalar(const float* x, const float* h, int n) {
+  float re = 0.0f, im = 0.0f;
+  for (int i=0; i<n; i+=2) {
+    re += x[i]   * h[i];
+    im += x[i+1] * h[i+1];
+  }
+  return std::complex<float>(re, im);
+}
+
+void mixDownScalar(const std::complex<float>* x, std::complex<float>* y,
+    int n, float phase, float frequency) {
+  std::complex<float> phasor   = std::polar(1.0f, -phase);
+  std::complex<float> rotation = std::polar(1.0f, -frequency);
+  for (int i=0; i<n; i++) {
+    y[i] = x[i] * phasor;
+    phasor *= rotation;
+  }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+std::complex<float> dotProductSSE2(const float* x, const float* h, int n) {
+  __m128 acc = _mm_setzero_ps();
+  int i=0;
+  for (; i+4<=n; i+=4)
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x+i), _mm_loadu_ps(h+i)));
+
+  float a[4];
+  _mm_storeu_ps(a, acc);
+  std::complex<float> result(a[0] + a[2], a[1] + a[3]);
+  return result + dotProductScalar(x+i, h+i, n-i);
+}
+
+// Complex multiply of interleaved pairs
+__attribute__((target("sse2")))
+inline __m128 complexMultiplySSE2(__m128 a, __m128 b) {
+  const __m128 sign = _mm_castsi128_ps(_mm_set_epi32(0, 0x80000000, 0,
+        0x80000000));
+  __m128 b_re = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+  __m128 b_im = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+  __m128 a_swapped = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_add_ps(_mm_mul_ps(a, b_re),
+                    _mm_xor_ps(_mm_mul_ps(a_swapped, b_im), sign));
+}
+
+__attribute__((target("sse2")))
+void mixDownSSE2(const std::complex<float>* x, std::complex<float>* y,
+    int n, float phase, float frequency) {
+  std::complex<float> p0 = std::polar(1.0f, -phase);
+  std::complex<float> p1 = p0 * std::polar(1.0f, -frequency);
+  std::complex<float> r  = std::polar(1.0f, -2 * frequency);
+
+  __m128 phasor   = _mm_set_ps(p1.imag(), p1.real(), p0.imag(), p0.real());
+  __m128 rotation = _mm_set_ps(r.imag(), r.real(), r.imag(), r.real());
+
+  const float* in = reinterpret_cast<const float*>(x);
+  float* out = reinterpret_cast<float*>(y);
+  int i=0;
+  for (; i+2<=n; i+=2) {
+    _mm_storeu_ps(out + 2*i,
+        complexMultiplySSE2(_mm_loadu_ps(in + 2*i), phasor));
+    phasor = complexMultiplySSE2(phasor, rotation);
+  }
+
+  float p[4];
+  _mm_storeu_ps(p, phasor);
+  std::complex<float> phasor_tail(p[0], p[1]);
+  for (; i<n; i++)
+    y[i] = x[i] * phasor_tail;
+}
+
+__attribute__((target("avx2,fma")))
+std::complex<float> dotProductAVX2(const float* x, const float* h, int n) {
+  __m256 acc = _mm256_setzero_ps();
+  int i=0;
+  for (; i+8<=n; i+=8)
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(x+i), _mm256_loadu_ps(h+i), acc);
+
+  float a[8];
+  _mm256_storeu_ps(a, acc);
+  std::complex<float> result(a[0] + a[2] + a[4] + a[6],
+                             a[1] + a[3] + a[5] + a[7]);
+  return result + dotProductScalar(x+i, h+i, n-i);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256 complexMultiplyAVX2(__m256 a, __m256 b) {
+  __m256 b_re = _mm256_moveldup_ps(b);
+  __m256 b_im = _mm256_movehdup_ps(b);
+  __m256 a_swapped = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm256_fmaddsub_ps(a, b_re, _mm256_mul_ps(a_swapped, b_im));
+}
+
+__attribute__((target("avx2,fma")))
+void mixDownAVX2(const std::complex<float>* x, std::complex<float>* y,
+    int n, float phase, float frequency) {
+  std::complex<float> p[4];
+  p[0] = std::polar(1.0f, -phase);
+  for (int k=1; k<4; k++)
+    p[k] = p[k-1] * std::polar(1.0f, -frequency);
+  std::complex<float> r = std::polar(1.0f, -4 * frequency);
+
+  __m256 phasor = _mm256_loadu_ps(reinterpret_cast<float*>(p));
+  __m256 rotation = _mm256_set_ps(r.imag(), r.real(), r.imag(), r.real(),
+                                  r.imag(), r.real(), r.imag(), r.real());
+
+  const float* in = reinterpret_cast<const float*>(x);
+  float* out = reinterpret_cast<float*>(y);
+  int i=0;
+  for (; i+4<=n; i+=4) {
+    _mm256_storeu_ps(out + 2*i,
+        complexMultiplyAVX2(_mm256_loadu_ps(in + 2*i), phasor));
+    phasor = complexMultiplyAVX2(phasor, rotation);
+  }
+
+  _mm256_storeu_ps(reinterpret_cast<float*>(p), phasor);
+  for (int k=0; i<n; i++, k++)
+    y[i] = x[i] * p[k];
+}
+
+#endif // HAVE_X86_KERNELS
+
+struct Kernels {
+  const char* name;
+  DotProductFunc dotProduct;
+  MixFunc mixDown;
+};
+
+Kernels selectKernels() {
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return {"avx2", dotProductAVX2, mixDownAVX2};
+  if (__builtin_cpu_supports("sse2"))
+    return {"sse2", dotProductSSE2, mixDownSSE2};
+#endif
+  return {"scalar", dotProductScalar, mixDownScalar};
+}
+
+const Kernels g_kernels = selectKernels();
+
+// Averaging of the pilot and signal power estimates in PilotPLL (~80 Hz at
+// 228 kHz)
+const float kPilotAveraging = 0.002f;
+
+// Pilot power relative to the whole MPX above which PilotPLL is locked
+// (-25 dB; a typical pilot is at -15 to -20 dB, noise at -35 dB)
+const float kPilotLockThreshold = 0.003f;
+
+float wrapPhase(float phase) {
+  while (phase >= M_PI)
+    phase -= 2 * M_PI;
+  while (phase < -M_PI)
+    phase += 2 * M_PI;
+  return phase;
+}
+
+// Reverse the taps so that they line up with a Window (oldest sample first),
+// and duplicate each for the real and imaginary parts
+std::vector<float> windowTaps(const std::vector<float>& h) {
+  std::vector<float> result(2 * h.size());
+  for (size_t i=0; i<h.size(); i++)
+    result[2*i] = result[2*i+1] = h[h.size() - 1 - i];
+  return result;
+}
+
+} // namespace
+
+const char* getInstructionSet() {
+  return g_kernels.name;
+}
+
+Window::Window(int len) : buffer_(4 * len), len_(len), pos_(0) {
+
+}
+
+// Each sample is stored twice, len_ apart, so the newest len_ samples are
+// always found in one piece starting at pos_
+void Window::push(std::complex<float> s) {
+  buffer_[2 * pos_]     = buffer_[2 * (pos_ + len_)]     = s.real();
+  buffer_[2 * pos_ + 1] = buffer_[2 * (pos_ + len_) + 1] = s.imag();
+  pos_ = (pos_ + 1) % len_;
+}
+
+const float* Window::data() const {
+  return &buffer_[2 * pos_];
+}
+
+int Window::length() const {
+  return len_;
+}
+
+FIRFilter::FIRFilter(int len, float fc, float As, float mu) : window_(len),
+  taps_() {
+  std::vector<float> h;
+  liquid::designKaiserFilter(len, fc, &h, As, mu);
+  taps_ = windowTaps(h);
+}
+
+void FIRFilter::push(std::complex<float> s) {
+  window_.push(s);
+}
+
+std::complex<float> FIRFilter::execute() {
+  return g_kernels.dotProduct(window_.data(), taps_.data(), taps_.size());
+}
+
+// Same update as liquid's agc_crcf
+AGC::AGC(float bw) : alpha_(bw), gain_(1.0f), energy_(1.0f) {
+
+}
+
+std::complex<float> AGC::execute(std::complex<float> s) {
+  std::complex<float> result = s * gain_;
+
+  energy_ = (1.0f - alpha_) * energy_ + alpha_ * std::norm(result);
+
+  if (energy_ > 1e-6f)
+    gain_ *= std::exp(-0.5f * alpha_ * std::log(energy_));
+
+  if (gain_ > 1e6f)
+    gain_ = 1e6f;
+
+  return result;
+}
+
+void AGC::setBandwidth(float bw) {
+  alpha_ = bw;
+}
+
+void AGC::setGain(float gain) {
+  gain_ = gain;
+  energy_ = 1.0f;
+}
+
+float AGC::getGain() const {
+  return gain_;
+}
+
+NCO::NCO(float freq) : phase_(0.0f), frequency_(freq), pll_alpha_(0.0f),
+  pll_beta_(0.0f) {
+
+}
+
+std::complex<float> NCO::mixDown(std::complex<float> s) {
+  return s * std::polar(1.0f, -phase_);
+}
+
+std::complex<float> NCO::mixUp(std::complex<float> s) {
+  return s * std::polar(1.0f, phase_);
+}
+
+void NCO::mixBlockDown(std::complex<float>* x, std::complex<float>* y,
+    int n) {
+  g_kernels.mixDown(x, y, n, phase_, frequency_);
+  phase_ = wrapPhase(std::fmod(phase_ + n * frequency_, 2 * M_PI));
+}
+
+void NCO::step() {
+  phase_ = wrapPhase(phase_ + frequency_);
+}
+
+void NCO::setFrequency(float freq) {
+  frequency_ = freq;
+}
+
+void NCO::setPLLBandwidth(float bw) {
+  pll_alpha_ = bw;
+  pll_beta_  = std::sqrt(bw);
+}
+
+void NCO::stepPLL(float dphi) {
+  frequency_ += dphi * pll_alpha_;
+  phase_ = wrapPhase(phase_ + dphi * pll_beta_);
+}
+
+// Kept in double precision: the loop's frequency steps are far below a
+// float's resolution at 19 kHz. The phase error is taken from the averaged
+// pilot, which is slow enough (~80 Hz) compared to the loop (~10 Hz) to
+// keep it stable.
+PilotPLL::PilotPLL(float freq, float bw) : phase_(0.0), frequency_(freq),
+  alpha_(bw), beta_(std::sqrt(bw)), pilot_(0.0f), power_(0.0f) {
+
+}
+
+void PilotPLL::mixBlockDown(const std::complex<float>* x,
+    std::complex<float>* y, int n) {
+
+  for (int i=0; i<n; i++) {
+    const float s = x[i].real();
+    const std::complex<float> lo = std::polar(1.0f, float(-phase_));
+
+    pilot_ += kPilotAveraging * (s * lo - pilot_);
+    power_ += kPilotAveraging * (s * s - power_);
+
+    y[i] = x[i] * lo * lo * lo;
+
+    const double dphi = std::arg(pilot_);
+    frequency_ += alpha_ * dphi;
+    phase_ = std::fmod(phase_ + frequency_ + beta_ * dphi, 2 * M_PI);
+  }
+
+}
+
+// The pilot's power is twice the power of its DC image after mixing
+bool PilotPLL::isLocked() const {
+  return 2.0f * std::norm(pilot_) > kPilotLockThreshold * power_;
+}
+
+// Starts as a pass-through with the center tap at one
+LMSEqualizer::LMSEqualizer(int len, float mu, float leakage) : window_(len),
+  taps_(len), mu_(mu), leakage_(leakage) {
+  taps_[len / 2] = 1.0f;
+}
+
+std::complex<float> LMSEqualizer::execute(std::complex<float> in) {
+  window_.push(in);
+  const float* w = window_.data();
+  std::complex<float> y = 0.0f;
+  for (size_t i=0; i<taps_.size(); i++) {
+    std::complex<float> x(w[2*i], w[2*i+1]);
+    y += taps_[i] * x;
+  }
+  return y;
+}
+
+// The input sample that the output lines up with
+std::complex<float> LMSEqualizer::getCenterSample() const {
+  const float* w = window_.data();
+  const int center = taps_.size() / 2;
+  return std::complex<float>(w[2*center], w[2*center+1]);
+}
+
+// error is the decision minus the last output. The step is normalized by
+// the power in the window, so that it doesn't depend on the signal level.
+void LMSEqualizer::train(std::complex<float> error) {
+  const float* w = window_.data();
+  float power = 1e-6f;
+  for (int i=0; i<2*window_.length(); i++)
+    power += w[i] * w[i];
+  const size_t center = taps_.size() / 2;
+  for (size_t i=0; i<taps_.size(); i++) {
+    std::complex<float> x(w[2*i], w[2*i+1]);
+    std::complex<float> pass_through = (i == center ? 1.0f : 0.0f);
+    taps_[i] += mu_ / power * error * std::conj(x) +
+                leakage_ * (pass_through - taps_[i]);
+  }
+}
+
+Goertzel::Goertzel(float freq) : coeff_(2.0f * std::cos(freq)) {
+
+}
+
+// Normalized so that a sinusoid of amplitude a gives a^2 / 4
+float Goertzel::execute(const std::vector<int16_t>& x) const {
+  float s1 = 0.0f;
+  float s2 = 0.0f;
+  for (int16_t sample : x) {
+    const float s0 = sample + coeff_ * s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  const float n = x.size();
+  return (s1 * s1 + s2 * s2 - coeff_ * s1 * s2) / (n * n);
+}
+
+void designSymSyncFilters(liquid_firfilt_type ftype, unsigned k, unsigned m,
+    float beta, unsigned num_filters, std::vector<std::vector<float>>* mf,
+    std::vector<std::vector<float>>* dmf) {
+
+  // Prototype filter at num_filters times the sample rate
+  const unsigned h_len = 2 * k * m * num_filters;
+  std::vector<float> h(h_len + 1);
+  liquid_firdes_prototype(ftype, k * num_filters, m, beta, 0.0f, h.data());
+  h.resize(h_len);
+
+  // Derivative filter for the timing error
+  std::vector<float> dh(h_len);
+  float hdh_max = 0.0f;
+  for (unsigned i=0; i<h_len; i++) {
+    dh[i] = h[(i + 1) % h_len] - h[(i + h_len - 1) % h_len];
+    hdh_max = std::max(hdh_max, std::fabs(h[i] * dh[i]));
+  }
+  for (float& d : dh)
+    d *= 0.06f / hdh_max;
+
+  // Split into polyphase branches
+  const unsigned branch_len = h_len / num_filters;
+  mf->assign(num_filters, std::vector<float>(branch_len));
+  dmf->assign(num_filters, std::vector<float>(branch_len));
+  for (unsigned b=0; b<num_filters; b++) {
+    for (unsigned i=0; i<branch_len; i++) {
+      (*mf)[b][i]  = h[b + i * num_filters];
+      (*dmf)[b][i] = dh[b + i * num_filters];
+    }
+  }
+
+}
+
+SymSync::SymSync(liquid_firfilt_type ftype, unsigned k, unsigned m,
+    float beta, unsigned num_filters) : k_(k), num_filters_(num_filters),
+  output_rate_(1), window_(2 * k * m), mf_taps_(num_filters),
+  dmf_taps_(num_filters), tau_(0.0f), filter_index_(0), decim_counter_(0),
+  rate_(k), del_(k), loop_kp_(0.0f), loop_ki_(0.0f) {
+
+  std::vector<std::vector<float>> mf, dmf;
+  designSymSyncFilters(ftype, k, m, beta, num_filters, &mf, &dmf);
+  for (unsigned b=0; b<num_filters; b++) {
+    mf_taps_[b]  = windowTaps(mf[b]);
+    dmf_taps_[b] = windowTaps(dmf[b]);
+  }
+
+  setBandwidth(0.01f);
+
+}
+
+// Proportional-integral loop filter with a damping factor of 1/sqrt(2)
+void designLoopFilter(float bw, float* kp, float* ki) {
+  const float zeta  = 1.0f / std::sqrt(2.0f);
+  const float theta = bw / (zeta + 0.25f / zeta);
+  const float denom = 1.0f + 2.0f * zeta * theta + theta * theta;
+  *kp = 4.0f * zeta * theta / denom;
+  *ki = 4.0f * theta * theta / denom;
+}
+
+void SymSync::setBandwidth(float bw) {
+  designLoopFilter(bw, &loop_kp_, &loop_ki_);
+}
+
+// r output samples per symbol; restarts the timing loop at the nominal rate
+void SymSync::setOutputRate(unsigned r) {
+  output_rate_ = r;
+  rate_ = float(k_) / r;
+  del_  = rate_;
+}
+
+void SymSync::advanceLoop(std::complex<float> mf, std::complex<float> dmf) {
+  float q = std::real(std::conj(mf) * dmf);
+  q = std::max(-1.0f, std::min(1.0f, q));
+
+  rate_ += loop_ki_ * q;
+  del_   = rate_ + loop_kp_ * q;
+}
+
+std::vector<std::complex<float>> SymSync::execute(std::complex<float> in) {
+
+  window_.push(in);
+
+  std::vector<std::complex<float>> result;
+  const int n = mf_taps_[0].size();
+
+  while (filter_index_ < (int)num_filters_) {
+    std::complex<float> mf = g_kernels.dotProduct(window_.data(),
+        mf_taps_[filter_index_].data(), n);
+
+    result.push_back(mf / float(k_));
+
+    if (decim_counter_ == output_rate_) {
+      decim_counter_ = 0;
+      std::complex<float> dmf = g_kernels.dotProduct(window_.data(),
+          dmf_taps_[filter_index_].data(), n);
+      advanceLoop(mf, dmf);
+    }
+
+    decim_counter_ ++;
+
+    tau_ += del_;
+    filter_index_ = int(std::round(tau_ * num_filters_));
+  }
+
+  tau_ -= 1.0f;
+  filter_index_ -= num_filters_;
+
+  return result;
+
+}
+
+} // namespace dsp
+} // namespace redsea
@@ -0,0 +1,166 @@
+#ifndef DSP_H_
+#define DSP_H_
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+#include "liquid_wrappers.h"
+
+namespace redsea {
+namespace dsp {
+
+// redsea's own versions of the liquid-dsp objects used by Subcarrier, with
+// the same interfaces as the wrappers in liquid_wrappers.h. Dot products and
+// block mixing run on scalar, SSE2 or AVX2/FMA code chosen at startup from
+// CPUID. Filter design still comes from liquid.
+
+// Name of the instruction set selected at startup ("avx2", "sse2", "scalar")
+const char* getInstructionSet();
+
+// Sample history that keeps the newest samples contiguous in memory, with
+// real and imaginary parts interleaved
+class Window {
+  public:
+    Window(int len);
+    void push(std::complex<float> s);
+    const float* data() const;
+    int length() const;
+
+  private:
+    std::vector<float> buffer_;
+    int len_;
+    int pos_;
+};
+
+class FIRFilter {
+  public:
+    FIRFilter(int len, float fc, float As=60.0f, float mu=0.0f);
+    void push(std::complex<float> s);
+    std::complex<float> execute();
+
+  private:
+    Window window_;
+    std::vector<float> taps_;
+};
+
+class AGC {
+  public:
+    AGC(float bw);
+    std::complex<float> execute(std::complex<float> s);
+    void setBandwidth(float bw);
+    void setGain(float gain);
+    float getGain() const;
+
+  private:
+    float alpha_;
+    float gain_;
+    float energy_;
+};
+
+class NCO {
+  public:
+    NCO(float freq);
+    std::complex<float> mixDown(std::complex<float> s);
+    std::complex<float> mixUp(std::complex<float> s);
+    void mixBlockDown(std::complex<float>* x, std::complex<float>* y,
+        int n);
+    void step();
+    void setFrequency(float freq);
+    void setPLLBandwidth(float);
+    void stepPLL(float dphi);
+
+  private:
+    float phase_;
+    float frequency_;
+    float pll_alpha_;
+    float pll_beta_;
+};
+
+// Phase-locked loop on the 19 kHz stereo pilot of an MPX signal. In stereo
+// broadcasts the RDS carrier is locked to the pilot's third harmonic, so it
+// can be mixed down by three times the pilot phase without waiting for the
+// carrier loop to pull in.
+class PilotPLL {
+  public:
+    PilotPLL(float freq, float bw);
+    void mixBlockDown(const std::complex<float>* x, std::complex<float>* y,
+        int n);
+    bool isLocked() const;
+
+  private:
+    double phase_;
+    double frequency_;
+    const double alpha_;
+    const double beta_;
+    std::complex<float> pilot_;
+    float power_;
+};
+
+// Symbol-spaced adaptive FIR equalizer, trained by normalized LMS on
+// decisions made from its own output. The taps leak back towards a
+// pass-through, which keeps them from drifting to a delayed or inverted
+// solution where the input has little energy to correct them.
+class LMSEqualizer {
+  public:
+    LMSEqualizer(int len, float mu, float leakage);
+    std::complex<float> execute(std::complex<float> in);
+    void train(std::complex<float> error);
+    std::complex<float> getCenterSample() const;
+
+  private:
+    Window window_;
+    std::vector<std::complex<float>> taps_;
+    const float mu_;
+    const float leakage_;
+};
+
+// Power of a single frequency component over a block of real samples
+class Goertzel {
+  public:
+    Goertzel(float freq);
+    float execute(const std::vector<int16_t>& x) const;
+
+  private:
+    const float coeff_;
+};
+
+// Matched and derivative filters for a polyphase symbol synchronizer, one
+// branch per filter, taps in time order
+void designSymSyncFilters(liquid_firfilt_type ftype, unsigned k, unsigned m,
+    float beta, unsigned num_filters, std::vector<std::vector<float>>* mf,
+    std::vector<std::vector<float>>* dmf);
+
+// Gains of the symbol synchronizer's loop filter for a given bandwidth
+void designLoopFilter(float bw, float* kp, float* ki);
+
+// Polyphase filterbank symbol synchronizer (as in liquid's symsync)
+class SymSync {
+  public:
+    SymSync(liquid_firfilt_type ftype, unsigned k, unsigned m,
+        float beta, unsigned num_filters);
+    void setBandwidth(float);
+    void setOutputRate(unsigned);
+    std::vector<std::complex<float>> execute(std::complex<float> in);
+
+  private:
+    void advanceLoop(std::complex<float> mf, std::complex<float> dmf);
+
+    const unsigned k_;
+    const unsigned num_filters_;
+    unsigned output_rate_;
+    Window window_;
+    std::vector<std::vector<float>> mf_taps_;
+    std::vector<std::vector<float>> dmf_taps_;
+    float tau_;
+    int filter_index_;
+    unsigned decim_counter_;
+    float rate_;
+    float del_;
+    float loop_kp_;
+    float loop_ki_;
+};
+
+} // namespace dsp
+} // namespace redsea
+#endif // DSP_H_
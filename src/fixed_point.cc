@@ -0,0 +1,249 @@
+#include "fixed_point.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "dsp.h"
+#include "liquid_wrappers.h"
+
+namespace redsea {
+namespace fixed {
+
+namespace {
+
+const int kSineTableBits = 12;
+const int kSineTableSize = 1 << kSineTableBits;
+
+// Q12: unity at the output of the AGC
+const int kUnityShift = 12;
+
+inline int16_t saturate(int64_t x) {
+  return std::max<int64_t>(INT16_MIN, std::min<int64_t>(INT16_MAX, x));
+}
+
+// Arithmetic shift in either direction
+inline int64_t shift(int64_t x, int n) {
+  return n >= 0 ? (x >> n) : (x * (int64_t(1) << -n));
+}
+
+// Q15 sine over one full turn, built on first use (thread-safe)
+const std::vector<int16_t>& sineTable() {
+  static const std::vector<int16_t> table = [] {
+    std::vector<int16_t> t(kSineTableSize);
+    for (int i=0; i<kSineTableSize; i++)
+      t[i] = std::round(INT16_MAX * std::sin(2 * M_PI * i / kSineTableSize));
+    return t;
+  }();
+  return table;
+}
+
+// Radians (per sample) to a 32-bit phase increment
+uint32_t phaseIncrement(double radians) {
+  return uint32_t(int64_t(std::round(radians / (2 * M_PI) * 4294967296.0)));
+}
+
+std::vector<float> kaiserTaps(int len, float fc) {
+  std::vector<float> h;
+  liquid::designKaiserFilter(len, fc, &h);
+  return h;
+}
+
+// Base-2 logarithm in Q8, with linear interpolation of the mantissa
+int32_t log2Q8(int64_t x) {
+  int msb = 63 - __builtin_clzll(x);
+  uint64_t mantissa = (uint64_t(x) << (63 - msb)) >> 55;
+  return (msb << 8) | (mantissa & 0xFF);
+}
+
+}
+
+Window::Window(int len) : buffer_(2 * len), len_(len), pos_(0) {
+
+}
+
+// Each sample is stored twice, len_ apart
+void Window::push(Complex s) {
+  buffer_[pos_] = buffer_[pos_ + len_] = s;
+  pos_ = (pos_ + 1) % len_;
+}
+
+const Complex* Window::data() const {
+  return &buffer_[pos_];
+}
+
+// Reversed to line up with a Window (oldest sample first)
+Taps::Taps(const std::vector<float>& h) : taps_(h.size()), shift_(0) {
+  float h_max = 0.0f;
+  for (float t : h)
+    h_max = std::max(h_max, std::fabs(t));
+
+  shift_ = std::floor(std::log2(INT16_MAX / h_max));
+
+  for (size_t i=0; i<h.size(); i++)
+    taps_[i] = std::round(std::ldexp(h[h.size() - 1 - i], shift_));
+}
+
+Complex Taps::execute(const Complex* x, int gain_shift) const {
+  int64_t acc_re = 0;
+  int64_t acc_im = 0;
+  for (size_t i=0; i<taps_.size(); i++) {
+    acc_re += int32_t(x[i].re) * taps_[i];
+    acc_im += int32_t(x[i].im) * taps_[i];
+  }
+  return {saturate(shift(acc_re, shift_ - gain_shift)),
+          saturate(shift(acc_im, shift_ - gain_shift))};
+}
+
+int Taps::length() const {
+  return taps_.size();
+}
+
+FIRFilter::FIRFilter(int len, float fc, int gain_shift) : window_(len),
+  taps_(kaiserTaps(len, fc)), gain_shift_(gain_shift) {
+
+}
+
+void FIRFilter::push(Complex s) {
+  window_.push(s);
+}
+
+Complex FIRFilter::execute() {
+  return taps_.execute(window_.data(), gain_shift_);
+}
+
+// Gain is Q16.16 and energy Q24 (unity at the output). Where dsp::AGC
+// multiplies the gain by exp(-alpha/2 * ln(energy)), this subtracts the
+// first-order term, alpha/2 * ln(2) * log2(energy), which is small enough
+// for the approximation to hold.
+AGC::AGC(float bw) : energy_shift_(0), loop_gain_(0), gain_(1 << 16),
+  energy_(1 << (2 * kUnityShift)) {
+  setBandwidth(bw);
+}
+
+void AGC::setBandwidth(float bw) {
+  energy_shift_ = std::round(-std::log2(bw));
+  loop_gain_ = std::round(0.5 * bw * M_LN2 * (1 << 16));
+}
+
+Complex AGC::execute(Complex s) {
+  Complex result = {saturate((int64_t(s.re) * gain_) >> 16),
+                    saturate((int64_t(s.im) * gain_) >> 16)};
+
+  int64_t norm = int32_t(result.re) * result.re +
+                 int32_t(result.im) * result.im;
+  energy_ += (norm - energy_) >> energy_shift_;
+
+  // Same floor as dsp::AGC, 1e-6
+  if (energy_ > 16) {
+    int32_t log_energy = log2Q8(energy_) - (2 * kUnityShift << 8);
+    int64_t gain = gain_ - ((int64_t(gain_) * log_energy * loop_gain_) >> 24);
+    gain_ = std::max<int64_t>(1, std::min<int64_t>(INT32_MAX, gain));
+  }
+
+  return result;
+}
+
+NCO::NCO(float freq) : phase_(0), frequency_(phaseIncrement(freq)),
+  pll_alpha_(0), pll_beta_(0) {
+  sineTable();
+}
+
+Complex NCO::mixDown(Complex s) {
+  const std::vector<int16_t>& table = sineTable();
+  const int index = (phase_ + (1u << (31 - kSineTableBits))) >>
+                    (32 - kSineTableBits);
+  const int32_t sine   = table[index];
+  const int32_t cosine = table[(index + kSineTableSize / 4) &
+                               (kSineTableSize - 1)];
+
+  return {saturate((int64_t(s.re) * cosine + int64_t(s.im) * sine) >> 15),
+          saturate((int64_t(s.im) * cosine - int64_t(s.re) * sine) >> 15)};
+}
+
+void NCO::mixBlockDown(const std::vector<int16_t>& x,
+    std::vector<Complex>* y) {
+  const std::vector<int16_t>& table = sineTable();
+  y->resize(x.size());
+  for (size_t i=0; i<x.size(); i++) {
+    const int index = (phase_ + (1u << (31 - kSineTableBits))) >>
+                      (32 - kSineTableBits);
+    const int32_t sine   = table[index];
+    const int32_t cosine = table[(index + kSineTableSize / 4) &
+                                 (kSineTableSize - 1)];
+    (*y)[i] = {saturate((x[i] * cosine) >> 15),
+               saturate(-(x[i] * sine) >> 15)};
+    phase_ += frequency_;
+  }
+}
+
+// dphi is Q12 radians
+void NCO::setPLLBandwidth(float bw) {
+  pll_alpha_ = phaseIncrement(bw / (1 << kUnityShift));
+  pll_beta_  = phaseIncrement(std::sqrt(bw) / (1 << kUnityShift));
+}
+
+void NCO::stepPLL(int32_t dphi) {
+  frequency_ += dphi * pll_alpha_;
+  phase_     += dphi * pll_beta_;
+}
+
+// Root raised cosine, as used by Subcarrier
+SymSync::SymSync(unsigned k, unsigned m, float beta, unsigned num_filters) :
+  k_(k), num_filters_(num_filters), window_(2 * k * m), mf_taps_(),
+  dmf_taps_(), tau_(0), filter_index_(0), has_output_(false),
+  rate_(k << 24), del_(k << 24), loop_kp_(0), loop_ki_(0) {
+
+  std::vector<std::vector<float>> mf, dmf;
+  dsp::designSymSyncFilters(LIQUID_FIRFILT_RRC, k, m, beta, num_filters,
+      &mf, &dmf);
+  for (unsigned b=0; b<num_filters; b++) {
+    mf_taps_.push_back(Taps(mf[b]));
+    dmf_taps_.push_back(Taps(dmf[b]));
+  }
+
+  setBandwidth(0.01f);
+
+}
+
+void SymSync::setBandwidth(float bw) {
+  float kp, ki;
+  dsp::designLoopFilter(bw, &kp, &ki);
+  loop_kp_ = std::round(std::ldexp(kp, 24));
+  loop_ki_ = std::round(std::ldexp(ki, 24));
+}
+
+std::vector<Complex> SymSync::execute(Complex in) {
+
+  window_.push(in);
+
+  std::vector<Complex> result;
+
+  while (filter_index_ < (int)num_filters_) {
+    Complex mf = mf_taps_[filter_index_].execute(window_.data());
+
+    result.push_back({int16_t(mf.re / int(k_)), int16_t(mf.im / int(k_))});
+
+    // Timing error, Q24
+    if (has_output_) {
+      Complex dmf = dmf_taps_[filter_index_].execute(window_.data());
+      int64_t q = int64_t(mf.re) * dmf.re + int64_t(mf.im) * dmf.im;
+      q = std::max<int64_t>(-(1 << 24), std::min<int64_t>(1 << 24, q));
+
+      rate_ += (loop_ki_ * q) >> 24;
+      del_   = rate_ + ((loop_kp_ * q) >> 24);
+    }
+    has_output_ = true;
+
+    tau_ += del_;
+    filter_index_ = (int64_t(tau_) * num_filters_ + (1 << 23)) >> 24;
+  }
+
+  tau_ -= 1 << 24;
+  filter_index_ -= num_filters_;
+
+  return result;
+
+}
+
+} // namespace fixed
+} // namespace redsea
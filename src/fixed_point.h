@@ -0,0 +1,115 @@
+#ifndef FIXED_POINT_H_
+#define FIXED_POINT_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace redsea {
+namespace fixed {
+
+// Integer-only versions of the objects in Subcarrier's signal chain, for
+// hosts where float throughput is the limit. Samples are 16-bit (Q15 before
+// the AGC, Q12 after it so that the signal has headroom above unity) and
+// products are accumulated in 64 bits and saturated back to 16. Filter taps
+// and loop constants are computed in floating point once, at construction.
+
+struct Complex {
+  int16_t re;
+  int16_t im;
+};
+
+// Sample history with the newest samples contiguous in memory, like
+// dsp::Window
+class Window {
+  public:
+    Window(int len);
+    void push(Complex s);
+    const Complex* data() const;
+
+  private:
+    std::vector<Complex> buffer_;
+    int len_;
+    int pos_;
+};
+
+// Taps quantized to 16 bits with a per-filter scale, so that the largest
+// tap uses the whole range
+class Taps {
+  public:
+    Taps(const std::vector<float>& h);
+    Complex execute(const Complex* x, int gain_shift=0) const;
+    int length() const;
+
+  private:
+    std::vector<int16_t> taps_;
+    int shift_;
+};
+
+class FIRFilter {
+  public:
+    FIRFilter(int len, float fc, int gain_shift);
+    void push(Complex s);
+    Complex execute();
+
+  private:
+    Window window_;
+    Taps taps_;
+    const int gain_shift_;
+};
+
+// Same loop as dsp::AGC, in the log2 domain; output is Q12
+class AGC {
+  public:
+    AGC(float bw);
+    Complex execute(Complex s);
+    void setBandwidth(float bw);
+
+  private:
+    int energy_shift_;
+    int32_t loop_gain_;
+    int32_t gain_;
+    int64_t energy_;
+};
+
+// Phase accumulator NCO with a sine table
+class NCO {
+  public:
+    NCO(float freq);
+    Complex mixDown(Complex s);
+    void mixBlockDown(const std::vector<int16_t>& x, std::vector<Complex>* y);
+    void setPLLBandwidth(float bw);
+    void stepPLL(int32_t dphi);
+
+  private:
+    uint32_t phase_;
+    uint32_t frequency_;
+    uint32_t pll_alpha_;
+    uint32_t pll_beta_;
+};
+
+// Polyphase symbol synchronizer with the same loop as dsp::SymSync; timing
+// is kept in Q24 input samples
+class SymSync {
+  public:
+    SymSync(unsigned k, unsigned m, float beta, unsigned num_filters);
+    void setBandwidth(float bw);
+    std::vector<Complex> execute(Complex in);
+
+  private:
+    const unsigned k_;
+    const unsigned num_filters_;
+    Window window_;
+    std::vector<Taps> mf_taps_;
+    std::vector<Taps> dmf_taps_;
+    int32_t tau_;
+    int filter_index_;
+    bool has_output_;
+    int32_t rate_;
+    int32_t del_;
+    int32_t loop_kp_;
+    int32_t loop_ki_;
+};
+
+} // namespace fixed
+} // namespace redsea
+#endif // FIXED_POINT_H_
@@ -1,8 +1,11 @@
 #include "groups.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <map>
+#include <stdexcept>
 #include <string>
 
 #include "rdsstring.h"
@@ -19,12 +22,16 @@ std::string GroupType::toString() {
   return std::string(std::to_string(num) + (ab == TYPE_A ? "A" : "B"));
 }
 
+int GroupType::code() const {
+  return (num << 1) | ab;
+}
+
 bool operator==(const GroupType& obj1, const GroupType& obj2) {
   return (obj1.num == obj2.num && obj1.ab == obj2.ab);
 }
 
 bool operator<(const GroupType& obj1, const GroupType& obj2) {
-  return ((obj1.num < obj2.num) || (obj1.ab < obj2.ab));
+  return ((obj1.num < obj2.num) || (obj1.num == obj2.num && obj1.ab < obj2.ab));
 }
 
 Group::Group(std::vector<uint16_t> blockbits) :
@@ -33,83 +40,286 @@ Group::Group(std::vector<uint16_t> blockbits) :
     block1(num_blocks > 0 ? blockbits[0] : 0x00),
     block2(num_blocks > 1 ? blockbits[1] : 0x00),
     block3(num_blocks > 2 ? blockbits[2] : 0x00),
-    block4(num_blocks > 3 ? blockbits[3] : 0x00)
+    block4(num_blocks > 3 ? blockbits[3] : 0x00), rx_time(-1.0)
 {
 
 }
 
-void Group::printHex() const {
+std::string Group::toHex(std::string suffix) const {
+  std::string result;
+
   if (num_blocks > 0)
-    printf("%04X ", block1);
+    appendf(&result, "%04X ", block1);
   else
-    printf("---- ");
+    result += "---- ";
 
   if (num_blocks > 1)
-    printf("%04X ", block2);
+    appendf(&result, "%04X ", block2);
   else
-    printf("---- ");
+    result += "---- ";
 
   if (num_blocks > 2)
-    printf("%04X ", block3);
+    appendf(&result, "%04X ", block3);
   else
-    printf("---- ");
+    result += "---- ";
 
   if (num_blocks > 3)
-    printf("%04X", block4);
+    appendf(&result, "%04X", block4);
   else
-    printf("----");
+    result += "----";
 
-  printf("\n");
+  if (!suffix.empty())
+    result += " " + suffix;
+
+  return result + "\n";
 }
 
 Station::Station() : Station(0x0000) {
 
 }
 
-Station::Station(uint16_t _pi) : pi_(_pi), ps_(8), rt_(64), rt_ab_(0), pty_(0),
-  is_tp_(false), is_ta_(false), is_music_(false), alt_freqs_(),
-  num_alt_freqs_(0), pin_(0), ecc_(0), cc_(0), tmc_id_(0), ews_channel_(0),
-  lang_(0), linkage_la_(0), clock_time_(""), has_country_(false),
-  oda_app_for_group_(), has_rt_plus_(false), pager_pac_(0), pager_opc_(0),
-  pager_tng_(0), pager_ecc_(0), pager_ccf_(0), pager_interval_(0), tmc_() {
+Station::Station(uint16_t _pi, std::string tag, const Options& options) :
+  pi_(_pi), pty_(0),
+  rt_ab_(0), is_tp_(false), is_ta_(false), is_music_(false),
+  has_country_(false), ps_(8), rt_(64), json_(), tag_(tag), alt_freqs_(),
+  num_alt_freqs_(0), pin_(0), tmc_id_(0), ews_channel_(0), ecc_(0), cc_(0),
+  lang_(0), linkage_la_(false), clock_time_(""), oda_app_for_group_(),
+  oda_apps_(), pager_(),
+  delta_(options.use_delta_output ? new DeltaEncoder() : nullptr),
+  snapshot_(options.snapshot_interval > 0.0 ? new SnapshotInfo() : nullptr),
+  fields_(options.fields.empty() ? nullptr :
+          new std::set<std::string>(options.fields.begin(),
+                                    options.fields.end())),
+  is_line_wanted_(true) {
+
+}
+
+// Where the decoders write their JSON; nowhere in snapshot mode, where only
+// the state is kept, or for groups that are only decoded for their state
+std::string* Station::output() {
+  return (snapshot_ || !is_line_wanted_) ? nullptr : &json_;
+}
+
+// Field selection (-f). Comments between members have no key and are left
+// out with it.
+bool Station::isSelected(const char* key) const {
+  return !fields_ || (key != nullptr && fields_->count(key) > 0);
+}
+
+// Where the member key is written, or nowhere if it wasn't selected
+std::string* Station::output(const char* key) {
+  return isSelected(key) ? output() : nullptr;
+}
+
+namespace {
+
+const size_t kMaxODAApps = 255;
+
+}
+
+// Types that ODAs can be announced on all go to decodeODAgroup, which falls
+// back to the type's own decoder when no ODA is using it
+const Station::GroupDecoder Station::kGroupDecoders[32] = {
+  &Station::decodeType0,     &Station::decodeType0,       // 0A 0B
+  &Station::decodeType1,     &Station::decodeType1,       // 1A 1B
+  &Station::decodeType2,     &Station::decodeType2,       // 2A 2B
+  &Station::decodeType3A,    &Station::decodeODAgroup,    // 3A 3B
+  &Station::decodeType4A,    &Station::decodeODAgroup,    // 4A 4B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 5A 5B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 6A 6B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 7A 7B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 8A 8B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 9A 9B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 10A 10B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 11A 11B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 12A 12B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 13A 13B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup,    // 14A 14B
+  &Station::decodeODAgroup,  &Station::decodeODAgroup     // 15A 15B
+};
+
+PagerInfo& Station::getPager() {
+  if (!pager_)
+    pager_.reset(new PagerInfo());
+  return *pager_;
+}
+
+// Starts the line with the members that are always written; returns their
+// length. Here and below, members whose values take work to format are
+// skipped when there is no line (in snapshot mode).
+size_t Station::beginLine(const Group& group) {
+  json_.clear();
+  if (output() == nullptr)
+    return 0;
+
+  appendf(output(), "{\"pi\":\"0x%04x\"", pi_);
+
+  if (!tag_.empty())
+    appendf(output(), ",%s", tag_.c_str());
 
+  if (group.rx_time >= 0.0)
+    appendf(output(), ",\"rx_time\":\"%sZ\"",
+        formatTime(group.rx_time, "%Y-%m-%dT%H:%M:%S", 3).c_str());
+
+  return json_.size();
 }
 
-void Station::update(Group group) {
+void Station::update(Group group, bool is_line_wanted) {
+
+  is_line_wanted_ = is_line_wanted;
+  size_t head_length = beginLine(group);
 
-  printf("{\"pi\":\"0x%04x\"", pi_);
+  if (snapshot_) {
+    snapshot_->num_groups++;
+    if (group.num_blocks >= 2)
+      snapshot_->group_counts[group.type.code()]++;
+  }
 
   if (group.num_blocks < 2) {
-    printf("}\n");
+    finishLine(head_length);
     return;
   }
 
-  printf(",\"group\":\"%s\"", group.type.toString().c_str());
-
   is_tp_   = bits(group.block2, 10, 1);
   pty_     = bits(group.block2,  5, 5);
 
-  printf(",\"tp\":\"%s\"", is_tp_ ? "true" : "false");
-  printf(",\"prog_type\":\"%s\"", getPTYname(pty_).c_str());
-
-  if      (group.type.num == 0)
-    decodeType0(group);
-  else if (group.type.num == 1)
-    decodeType1(group);
-  else if (group.type.num == 2)
-    decodeType2(group);
-  else if (group.type.num == 3 && group.type.ab == TYPE_A)
-    decodeType3A(group);
-  else if (group.type.num == 4 && group.type.ab == TYPE_A)
-    decodeType4A(group);
-  else if (oda_app_for_group_.count(group.type) > 0)
-    decodeODAgroup(group);
-  else if (group.type.num == 6)
-    decodeType6(group);
-  else
-    printf(" /* TODO */ ");
+  if (output("group") != nullptr)
+    appendf(output(), ",\"group\":\"%s\"", group.type.toString().c_str());
+  appendf(output("tp"), ",\"tp\":\"%s\"", is_tp_ ? "true" : "false");
+  if (output("prog_type") != nullptr)
+    appendf(output(), ",\"prog_type\":\"%s\"", getPTYname(pty_).c_str());
+
+  (this->*kGroupDecoders[group.type.code()])(group);
+
+  finishLine(head_length);
+}
+
+// Type C groups carry a function header and data of an RDS2 ODA (such as
+// RFT, for station logos) in all four blocks. None of these are decoded
+// yet, so the blocks are written as they are.
+void Station::updateTypeC(Group group) {
+
+  is_line_wanted_ = true;
+  size_t head_length = beginLine(group);
+
+  if (snapshot_)
+    snapshot_->num_groups++;
+
+  appendf(output("group"), ",\"group\":\"C\"");
+  if (output("raw_data") != nullptr) {
+    const uint16_t blocks[] = {group.block1, group.block2, group.block3,
+                               group.block4};
+    appendf(output(), ",\"raw_data\":\"");
+    for (int i=0; i<group.num_blocks; i++)
+      appendf(output(), "%04x", blocks[i]);
+    appendf(output(), "\"");
+  }
+
+  finishLine(head_length);
+}
+
+// Closes the line, or in delta mode replaces it with the changes (or an
+// empty line if there are none). With -f, a line without any of the
+// selected members is left empty.
+void Station::finishLine(size_t head_length) {
+  if (snapshot_)
+    return;
+
+  if (!is_line_wanted_ || (fields_ && json_.size() == head_length)) {
+    json_.clear();
+    return;
+  }
+
+  if (!delta_) {
+    json_ += "}\n";
+    return;
+  }
+
+  std::string line;
+  if (!delta_->encode(json_.substr(0, head_length),
+                      json_.substr(head_length), &line))
+    line.clear();
+  json_ = line;
+}
+
+bool Station::writeSnapshot(double time, std::string* json) {
+  if (!snapshot_ || snapshot_->num_groups == 0)
+    return false;
+
+  appendf(json, "{\"pi\":\"0x%04x\"", pi_);
+
+  if (!tag_.empty())
+    appendf(json, ",%s", tag_.c_str());
+
+  appendf(json, ",\"time\":%.1f", time);
+
+  size_t head_length = json->size();
 
-  printf("}\n");
+  const std::string& ps = ps_.getLastCompleteString();
+  if (isSelected("ps") && ps.find_first_not_of(' ') != std::string::npos)
+    appendf(json, ",\"ps\":\"%s\"", ps.c_str());
+
+  if (isSelected("radiotext")) {
+    std::string rt = rt_.getLastCompleteStringTrimmed();
+    if (rt.find_first_not_of(' ') != std::string::npos)
+      appendf(json, ",\"radiotext\":\"%s\"", rt.c_str());
+  }
+
+  if (isSelected("prog_type"))
+    appendf(json, ",\"prog_type\":\"%s\"", getPTYname(pty_).c_str());
+  if (isSelected("tp"))
+    appendf(json, ",\"tp\":\"%s\"", is_tp_ ? "true" : "false");
+  if (isSelected("ta"))
+    appendf(json, ",\"ta\":\"%s\"", is_ta_ ? "true" : "false");
+
+  if (isSelected("alt_freqs") && !snapshot_->alt_freqs.empty()) {
+    std::vector<std::string> freqs;
+    for (double f : snapshot_->alt_freqs) {
+      std::string freq;
+      appendf(&freq, "\"%.1f\"", f);
+      freqs.push_back(freq);
+    }
+    appendf(json, ",\"alt_freqs\":[%s]", join(freqs, ",").c_str());
+  }
+
+  if (isSelected("clock_time") && !clock_time_.empty())
+    appendf(json, ",\"clock_time\":\"%s\"", clock_time_.c_str());
+
+  if (has_country_) {
+    if (isSelected("ecc"))
+      appendf(json, ",\"ecc\":\"0x%02x\"", ecc_);
+    if (isSelected("country"))
+      appendf(json, ",\"country\":\"%s\"",
+          getCountryString(pi_, ecc_).c_str());
+  }
+
+  for (const ODAApp& app : oda_apps_)
+    if (app.handler && isSelected(app.handler->getJSONKey()))
+      app.handler->writeSnapshot(json);
+
+  const bool has_groups = isSelected("groups");
+  appendf(has_groups ? json : nullptr, ",\"groups\":{");
+  bool is_first = true;
+  for (int code=0; code<32; code++) {
+    if (snapshot_->group_counts[code] == 0)
+      continue;
+    appendf(has_groups ? json : nullptr, "%s\"%s\":%u",
+        is_first ? "" : ",", GroupType(code).toString().c_str(),
+        snapshot_->group_counts[code]);
+    snapshot_->group_counts[code] = 0;
+    is_first = false;
+  }
+  appendf(has_groups ? json : nullptr, "}");
+
+  snapshot_->num_groups = 0;
+
+  if (fields_ && json->size() == head_length) {
+    json->clear();
+    return false;
+  }
+
+  appendf(json, "}\n");
+  return true;
 }
 
 void Station::addAltFreq(uint8_t af_code) {
@@ -130,6 +340,10 @@ bool Station::hasPS() const {
   return ps_.isComplete();
 }
 
+bool Station::hasRT() const {
+  return rt_.isComplete();
+}
+
 std::string Station::getPS() const {
   return ps_.getLastCompleteString();
 }
@@ -142,6 +356,14 @@ uint16_t Station::getPI() const {
   return pi_;
 }
 
+int Station::getPTY() const {
+  return pty_;
+}
+
+std::string Station::getJSON() const {
+  return json_;
+}
+
 std::string Station::getCountryCode() const {
   return getCountryString(pi_, ecc_);
 }
@@ -151,8 +373,8 @@ void Station::updatePS(int pos, std::vector<int> chars) {
   for (int i=pos; i<pos+(int)chars.size(); i++)
     ps_.setAt(i, chars[i-pos]);
 
-  if (ps_.isComplete())
-    printf(",\"ps\":\"%s\"",ps_.getLastCompleteString().c_str());
+  if (ps_.isComplete() && output("ps") != nullptr)
+    appendf(output(), ",\"ps\":\"%s\"",ps_.getLastCompleteString().c_str());
 
 }
 
@@ -171,7 +393,7 @@ void Station::decodeType0 (Group group) {
   is_ta_    = bits(group.block2, 4, 1);
   is_music_ = bits(group.block2, 3, 1);
 
-  printf(",\"ta\":\"%s\"", is_ta_ ? "true" : "false");
+  appendf(output("ta"), ",\"ta\":\"%s\"", is_ta_ ? "true" : "false");
 
   if (group.num_blocks < 3)
     return;
@@ -182,15 +404,19 @@ void Station::decodeType0 (Group group) {
     }
 
     if ((int)alt_freqs_.size() == num_alt_freqs_ && num_alt_freqs_ > 0) {
-      printf(",\"alt_freqs\":[");
-      int i = 0;
-      for (auto f : alt_freqs_) {
-        printf("\"%.1f\"", f);
-        if (i < (int)alt_freqs_.size() - 1)
-          printf(",");
-        i++;
+      if (output("alt_freqs") != nullptr) {
+        appendf(output(), ",\"alt_freqs\":[");
+        int i = 0;
+        for (auto f : alt_freqs_) {
+          appendf(output(), "\"%.1f\"", f);
+          if (i < (int)alt_freqs_.size() - 1)
+            appendf(output(), ",");
+          i++;
+        }
+        appendf(output(), "]");
       }
-      printf("]");
+      if (snapshot_)
+        snapshot_->alt_freqs = alt_freqs_;
       alt_freqs_.clear();
     }
   }
@@ -212,38 +438,41 @@ void Station::decodeType1 (Group group) {
   pin_ = group.block4;
 
   if (pin_ != 0x0000)
-    printf(",\"prog_item_started\":{\"day\":%d,\"time\":\"%02d:%02d\"}",
+    appendf(output("prog_item_started"),
+        ",\"prog_item_started\":{\"day\":%d,\"time\":\"%02d:%02d\"}",
         bits(pin_, 11, 5), bits(pin_, 6, 5), bits(pin_, 0, 6) );
 
   if (group.type.ab == TYPE_A) {
-    pager_tng_ = bits(group.block2, 2, 3);
-    if (pager_tng_ != 0) {
-      pager_interval_ = bits(group.block2, 0, 2);
+    int pager_tng = bits(group.block2, 2, 3);
+    if (pager_tng != 0 || pager_) {
+      getPager().tng = pager_tng;
+      if (pager_tng != 0)
+        pager_->interval = bits(group.block2, 0, 2);
     }
     linkage_la_ = bits(group.block3, 15, 1);
 
     int slc_variant = bits(group.block3, 12, 3);
 
     if (slc_variant == 0) {
-      if (pager_tng_ != 0) {
-        pager_opc_ = bits(group.block3, 8, 4);
+      if (pager_tng != 0) {
+        pager_->opc = bits(group.block3, 8, 4);
       }
 
       // No PIN, section M.3.2.4.3
       if (group.num_blocks == 4 && (group.block4 >> 11) == 0) {
         int subtype = bits(group.block4, 10, 1);
         if (subtype == 0) {
-          if (pager_tng_ != 0) {
-            pager_pac_ = bits(group.block4, 4, 6);
-            pager_opc_ = bits(group.block4, 0, 4);
+          if (pager_tng != 0) {
+            pager_->pac = bits(group.block4, 4, 6);
+            pager_->opc = bits(group.block4, 0, 4);
           }
         } else if (subtype == 1) {
-          if (pager_tng_ != 0) {
+          if (pager_tng != 0) {
             int b = bits(group.block4, 8, 2);
             if (b == 0) {
-              pager_ecc_ = bits(group.block4, 0, 6);
+              pager_->ecc = bits(group.block4, 0, 6);
             } else if (b == 3) {
-              pager_ccf_ = bits(group.block4, 0, 4);
+              pager_->ccf = bits(group.block4, 0, 4);
             }
           }
         }
@@ -255,34 +484,36 @@ void Station::decodeType1 (Group group) {
       if (ecc_ != 0x00) {
         has_country_ = true;
 
-        printf(",\"country\":\"%s\"", getCountryString(pi_, ecc_).c_str());
+        if (output("country") != nullptr)
+          appendf(output(), ",\"country\":\"%s\"",
+              getCountryString(pi_, ecc_).c_str());
       }
 
     } else if (slc_variant == 1) {
       tmc_id_ = bits(group.block3, 0, 12);
-      printf(",\"tmc_id\":\"0x%03x\"", tmc_id_);
+      appendf(output("tmc_id"), ",\"tmc_id\":\"0x%03x\"", tmc_id_);
 
     } else if (slc_variant == 2) {
-      if (pager_tng_ != 0) {
-        pager_pac_ = bits(group.block3, 0, 6);
-        pager_opc_ = bits(group.block3, 8, 4);
+      if (pager_tng != 0) {
+        pager_->pac = bits(group.block3, 0, 6);
+        pager_->opc = bits(group.block3, 8, 4);
       }
 
       // No PIN, section M.3.2.4.3
       if (group.num_blocks == 4 && (group.block4 >> 11) == 0) {
         int subtype = bits(group.block4, 10, 1);
         if (subtype == 0) {
-          if (pager_tng_ != 0) {
-            pager_pac_ = bits(group.block4, 4, 6);
-            pager_opc_ = bits(group.block4, 0, 4);
+          if (pager_tng != 0) {
+            pager_->pac = bits(group.block4, 4, 6);
+            pager_->opc = bits(group.block4, 0, 4);
           }
         } else if (subtype == 1) {
-          if (pager_tng_ != 0) {
+          if (pager_tng != 0) {
             int b = bits(group.block4, 8, 2);
             if (b == 0) {
-              pager_ecc_ = bits(group.block4, 0, 6);
+              pager_->ecc = bits(group.block4, 0, 6);
             } else if (b == 3) {
-              pager_ccf_ = bits(group.block4, 0, 4);
+              pager_->ccf = bits(group.block4, 0, 4);
             }
           }
         }
@@ -290,7 +521,9 @@ void Station::decodeType1 (Group group) {
 
     } else if (slc_variant == 3) {
       lang_ = bits(group.block3, 0, 8);
-      printf(",\"language\":\"%s\"", getLanguageString(lang_).c_str());
+      if (output("language") != nullptr)
+        appendf(output(), ",\"language\":\"%s\"",
+            getLanguageString(lang_).c_str());
 
     } else if (slc_variant == 6) {
       // TODO:
@@ -298,7 +531,7 @@ void Station::decodeType1 (Group group) {
 
     } else if (slc_variant == 7) {
       ews_channel_ = bits(group.block3, 0, 12);
-      printf(",\"ews\":\"0x%03x\"", ews_channel_);
+      appendf(output("ews"), ",\"ews\":\"0x%03x\"", ews_channel_);
     }
 
   }
@@ -331,8 +564,9 @@ void Station::decodeType2 (Group group) {
         {bits(group.block4, 8, 8), bits(group.block4, 0, 8)});
   }
 
-  if (rt_.isComplete())
-    printf(",\"radiotext\":\"%s\"",rt_.getLastCompleteStringTrimmed().c_str());
+  if (rt_.isComplete() && output("radiotext") != nullptr)
+    appendf(output(), ",\"radiotext\":\"%s\"",
+        rt_.getLastCompleteStringTrimmed().c_str());
 
 }
 
@@ -349,21 +583,31 @@ void Station::decodeType3A (Group group) {
   uint16_t oda_msg = group.block3;
   uint16_t oda_aid = group.block4;
 
-  oda_app_for_group_[oda_group] = oda_aid;
+  size_t app = 0;
+  while (app < oda_apps_.size() && oda_apps_[app].aid != oda_aid)
+    app++;
+  // (the index is 8 bits; a station with this many is just noise)
+  if (app == oda_apps_.size() && app < kMaxODAApps)
+    oda_apps_.push_back({oda_aid, createODAHandler(oda_aid)});
+
+  ODAHandler* handler = nullptr;
+  if (app < oda_apps_.size()) {
+    oda_app_for_group_[oda_group.code()] = app + 1;
+    handler = oda_apps_[app].handler.get();
+  }
 
-  printf(",\"open_data_app\":{\"oda_group\":\"%s\",\"app_name\":\"%s\"",
-      oda_group.toString().c_str(), getAppName(oda_aid).c_str());
+  std::string* json = output("open_data_app");
+  if (json != nullptr)
+    appendf(json,
+        ",\"open_data_app\":{\"oda_group\":\"%s\",\"app_name\":\"%s\"",
+        oda_group.toString().c_str(), getAppName(oda_aid).c_str());
 
-  if (oda_aid == 0xCD46 || oda_aid == 0xCD47) {
-    printf("}");
-    tmc_.systemGroup(group.block3);
-  } else if (oda_aid == 0x4BD7) {
-    has_rt_plus_ = true;
-    rt_plus_cb_ = bits(group.block3, 12, 1);
-    rt_plus_scb_ = bits(group.block3, 8, 4);
-    rt_plus_template_num_ = bits(group.block3, 0, 8);
+  if (handler) {
+    appendf(json, "}");
+    handler->announce(oda_msg, output(handler->getJSONKey()));
   } else {
-    printf(" /* TODO: Unimplemented ODA app */ ,\"message\":\"0x%02x\"}",
+    appendf(json,
+        " /* TODO: Unimplemented ODA app */ ,\"message\":\"0x%02x\"}",
         oda_msg);
   }
 
@@ -406,9 +650,10 @@ void Station::decodeType4A (Group group) {
       snprintf(buff, sizeof(buff),
           "%04d-%02d-%02dT%02d:%02d:00%+03d:%02d",yr,mo,dy,hr,mn,int(lto),ltom);
       clock_time_ = buff;
-      printf(",\"clock_time\":\"%s\"", clock_time_.c_str());
+      appendf(output("clock_time"), ",\"clock_time\":\"%s\"",
+          clock_time_.c_str());
     } else {
-      printf("/* invalid date/time */");
+      appendf(output(nullptr), "/* invalid date/time */");
     }
 
   }
@@ -416,79 +661,394 @@ void Station::decodeType4A (Group group) {
 
 /* Group 6: In-house applications */
 void Station::decodeType6 (Group group) {
-  printf(", \"in_house_data\":[\"0x%03x\"",
+  std::string* json = output("in_house_data");
+  if (json == nullptr)
+    return;
+
+  appendf(json, ", \"in_house_data\":[\"0x%03x\"",
       bits(group.block2, 0, 5));
 
   if (group.type.ab == TYPE_A) {
     if (group.num_blocks > 2) {
-      printf(",\"0x%04x\"", bits(group.block3, 0, 16));
+      appendf(json, ",\"0x%04x\"", bits(group.block3, 0, 16));
     } else {
-      printf(",\"(not received)\"");
+      appendf(json, ",\"(not received)\"");
     }
     if (group.num_blocks > 3) {
-      printf(",\"0x%04x\"", bits(group.block4, 0, 16));
+      appendf(json, ",\"0x%04x\"", bits(group.block4, 0, 16));
     } else {
-      printf(",\"(not received)\"");
+      appendf(json, ",\"(not received)\"");
     }
   } else {
     if (group.num_blocks > 3) {
-      printf(",\"0x%04x\"", bits(group.block4, 0, 16));
+      appendf(json, ",\"0x%04x\"", bits(group.block4, 0, 16));
     } else {
-      printf(",\"(not received)\"");
+      appendf(json, ",\"(not received)\"");
     }
   }
 
-  printf("]");
+  appendf(json, "]");
 
 }
 
 /* Open Data Application */
 void Station::decodeODAgroup (Group group) {
 
-  if (oda_app_for_group_.count(group.type) == 0)
+  int app = oda_app_for_group_[group.type.code()];
+
+  if (app == 0) {
+    if (group.type.num == 6)
+      decodeType6(group);
+    else
+      appendf(output(nullptr), " /* TODO */ ");
     return;
+  }
 
-  uint16_t aid = oda_app_for_group_[group.type];
+  ODAHandler* handler = oda_apps_[app - 1].handler.get();
+  if (handler)
+    handler->decode(group, *this, output(handler->getJSONKey()));
+
+}
+
+namespace {
+
+const int kEmptySlot = -1;
+
+// Seconds of signal per group (104 bits at 1187.5 bps)
+const double kGroupDuration = 104 / 1187.5;
+
+// The minute edge that CT marks is at the end of the 4A group
+const double kCTGroupSamples = 104 * 192;
+
+// Two CT groups must agree on the time origin to this many seconds
+const double kMaxCTOriginError = 1.0;
+
+// The UTC of a CT group (4A) in seconds since the epoch; false if it has
+// none or it's invalid
+bool decodeClockTime(const Group& group, double* utc) {
+  if (group.num_blocks < 4 || group.type.num != 4 || group.type.ab != TYPE_A)
+    return false;
+
+  int mjd = (bits(group.block2, 0, 2) << 15) + bits(group.block3, 1, 15);
+  int hr = (bits(group.block3, 0, 1) << 4) + bits(group.block4, 12, 4);
+  int mn = bits(group.block4, 6, 6);
 
-  if (aid == 0xCD46 || aid == 0xCD47) {
-    tmc_.userGroup(bits(group.block2, 0, 5), group.block3, group.block4);
-  } else if (aid == 0x4BD7) {
-    parseRadioTextPlus(group);
+  // MJD 40587 is 1970-01-01
+  if (mjd < 40587 || hr > 23 || mn > 59)
+    return false;
+
+  *utc = (mjd - 40587) * 86400.0 + hr * 3600 + mn * 60;
+  return true;
+}
+
+std::string jsonTag(std::string tag_key, std::string tag) {
+  return tag.empty() ? "" : "\"" + tag_key + "\":\"" + tag + "\"";
+}
+
+}
+
+StationTable::StationTable(const Options& options, std::string tag) :
+  max_size_(std::min(std::max(options.max_stations, 1), kMaxStationLimit)),
+  tag_(tag), options_(options), index_bits_(1), index_(), stations_(),
+  newer_(), older_(), newest_(kEmptySlot), oldest_(kEmptySlot),
+  num_evictions_(0) {
+
+  // At most half full, to keep the probe sequences short
+  while ((size_t(1) << index_bits_) < 2 * max_size_)
+    index_bits_++;
+  index_.resize(size_t(1) << index_bits_, kEmptySlot);
+
+}
+
+size_t StationTable::hash(uint16_t pi) const {
+  return uint16_t(pi * 40503u) >> (16 - index_bits_);
+}
+
+// Where the PI is in the index, or the empty position where it would go
+size_t StationTable::findPosition(uint16_t pi) const {
+  const size_t mask = index_.size() - 1;
+  size_t pos = hash(pi);
+  while (index_[pos] != kEmptySlot && stations_[index_[pos]].getPI() != pi)
+    pos = (pos + 1) & mask;
+  return pos;
+}
+
+// Linear probing deletion: later entries of the probe sequence are shifted
+// back into the hole, so that lookups never need tombstones
+void StationTable::removeFromIndex(uint16_t pi) {
+  const size_t mask = index_.size() - 1;
+  size_t hole = findPosition(pi);
+  size_t pos = hole;
+
+  while (true) {
+    pos = (pos + 1) & mask;
+    if (index_[pos] == kEmptySlot)
+      break;
+
+    size_t home = hash(stations_[index_[pos]].getPI());
+    bool can_move = (hole <= pos ? (home <= hole || home > pos) :
+                                   (home <= hole && home > pos));
+    if (can_move) {
+      index_[hole] = index_[pos];
+      hole = pos;
+    }
+  }
+
+  index_[hole] = kEmptySlot;
+}
+
+void StationTable::unlinkSlot(int slot) {
+  if (older_[slot] != kEmptySlot)
+    newer_[older_[slot]] = newer_[slot];
+  else
+    oldest_ = newer_[slot];
+
+  if (newer_[slot] != kEmptySlot)
+    older_[newer_[slot]] = older_[slot];
+  else
+    newest_ = older_[slot];
+}
+
+void StationTable::linkNewest(int slot) {
+  older_[slot] = newest_;
+  newer_[slot] = kEmptySlot;
+  if (newest_ != kEmptySlot)
+    newer_[newest_] = slot;
+  else
+    oldest_ = slot;
+  newest_ = slot;
+}
+
+Station& StationTable::get(uint16_t pi) {
+  size_t pos = findPosition(pi);
+  int slot = index_[pos];
+
+  if (slot == kEmptySlot) {
+    if (stations_.size() < max_size_) {
+      slot = stations_.size();
+      stations_.push_back(Station(pi, tag_, options_));
+      newer_.push_back(kEmptySlot);
+      older_.push_back(kEmptySlot);
+    } else {
+      slot = oldest_;
+      unlinkSlot(slot);
+      removeFromIndex(stations_[slot].getPI());
+      stations_[slot] = Station(pi, tag_, options_);
+      num_evictions_++;
+      pos = findPosition(pi);
+    }
+    index_[pos] = slot;
+    linkNewest(slot);
+  } else if (slot != newest_) {
+    unlinkSlot(slot);
+    linkNewest(slot);
   }
 
+  return stations_[slot];
 }
 
-void Station::parseRadioTextPlus(Group group) {
-  //bool item_toggle  = bits(group.block2, 4, 1);
-  bool item_running = bits(group.block2, 3, 1);
+const Station& StationTable::at(uint16_t pi) const {
+  size_t pos = findPosition(pi);
+  if (index_[pos] == kEmptySlot)
+    throw std::out_of_range("no station for PI");
+  return stations_[index_[pos]];
+}
 
-  printf(",\"radiotext_plus\":{\"item_running\":\"%s\"",
-      item_running ? "true" : "false");
+size_t StationTable::getNumEvictions() const {
+  return num_evictions_;
+}
+
+void StationTable::forEach(std::function<void(Station&)> function) {
+  for (Station& station : stations_)
+    function(station);
+}
+
+GroupHandler::GroupHandler(const Options& options, std::string tag_key,
+    std::string tag) : output_type_(options.output_type), tag_(tag),
+  snapshot_interval_(options.snapshot_interval), clock_(0.0),
+  next_snapshot_(options.snapshot_interval), has_input_clock_(false),
+  snapshot_handler_(),
+  filter_(options.filter), time_base_(options.time_base),
+  time_origin_(options.start_time),
+  has_time_origin_(options.time_base == TIME_START), ct_origin_(0.0),
+  has_ct_origin_(false), pi_(0), prev_new_pi_(0),
+  new_pi_(0), followed_pi_(0),
+  stations_(options, jsonTag(tag_key, tag)),
+  max_stations_(options.max_stations), diagnostic_handler_(),
+  use_cycle_counter_(!options.stats_path.empty()), stats_() {
+
+}
 
-  std::vector<RTPlusTag> tags(2);
+void GroupHandler::handle(std::vector<uint16_t> blockbits, int64_t sample) {
+  std::string line;
+  if (decode(blockbits, &line, sample) && !line.empty())
+    fputs(line.c_str(), stdout);
 
-  tags[0].content_type = (bits(group.block2, 0, 3) << 3) +
-                          bits(group.block3, 13, 3);
-  tags[0].start  = bits(group.block3, 7, 6);
-  tags[0].length = bits(group.block3, 1, 6) + 1;
+  if (!blockbits.empty())
+    countGroup();
+}
 
-  tags[1].content_type = (bits(group.block3, 0, 1) << 5) +
-                          bits(group.block4, 11, 5);
-  tags[1].start  = bits(group.block4, 5, 6);
-  tags[1].length = bits(group.block4, 0, 5) + 1;
+void GroupHandler::countGroup() {
+  if (snapshot_interval_ > 0.0 && !has_input_clock_) {
+    clock_ += kGroupDuration;
+    if (clock_ >= next_snapshot_)
+      printSnapshots();
+  }
+}
 
-  std::string rt = rt_.getLastCompleteString();
+void GroupHandler::setSnapshotHandler(
+    const std::function<void(const std::string& json)>& handler) {
+  snapshot_handler_ = handler;
+}
 
-  for (RTPlusTag tag : tags) {
-    if (rt.length() >= tag.start + tag.length && tag.length > 1) {
-      printf(",\"%s\":\"%s\"",
-          getRTPlusContentTypeName(tag.content_type).c_str(),
-          rt.substr(tag.start, tag.length).c_str());
+void GroupHandler::updateClock(double seconds) {
+  has_input_clock_ = true;
+  clock_ = seconds;
+  if (snapshot_interval_ > 0.0 && clock_ >= next_snapshot_)
+    printSnapshots();
+}
+
+// Evictions are reported in every mode, as they mean that -m is too low
+void GroupHandler::endInput() {
+  if (snapshot_interval_ > 0.0 && output_type_ == OUTPUT_JSON)
+    printSnapshots();
+
+  if (stats_.num_evicted_stations > 0) {
+    char line[128];
+    snprintf(line, sizeof(line), "stations%s%s: %llu evicted (limit %d, "
+        "see -m)", tag_.empty() ? "" : " ", tag_.c_str(),
+        (unsigned long long)stats_.num_evicted_stations, max_stations_);
+    if (diagnostic_handler_)
+      diagnostic_handler_(line);
+    else
+      fprintf(stderr, "%s\n", line);
+  }
+}
+
+void GroupHandler::setDiagnosticHandler(
+    const std::function<void(const std::string& line)>& handler) {
+  diagnostic_handler_ = handler;
+}
+
+void GroupHandler::printSnapshots() {
+  if (output_type_ == OUTPUT_JSON) {
+    stations_.forEach([this](Station& station) {
+      std::string snapshot;
+      if (!station.writeSnapshot(clock_, &snapshot))
+        return;
+      if (snapshot_handler_)
+        snapshot_handler_(snapshot);
+      else
+        fputs(snapshot.c_str(), stdout);
+    });
+    if (!snapshot_handler_)
+      fflush(stdout);
+  }
+
+  while (next_snapshot_ <= clock_)
+    next_snapshot_ += snapshot_interval_;
+}
+
+bool GroupHandler::decode(std::vector<uint16_t> blockbits,
+    std::string* line, int64_t sample) {
+
+  if (blockbits.size() == 0)
+    return false;
+
+  const bool is_type_c = followed_pi_ != 0 && blockbits[0] != followed_pi_;
+
+  // The PI is confirmed on every group, before the filter, so that the
+  // first group that passes it isn't needed for the confirmation
+  if (followed_pi_ != 0) {
+    pi_ = followed_pi_;
+
+  } else {
+    prev_new_pi_ = new_pi_;
+    new_pi_ = blockbits[0];
+
+    if (new_pi_ == prev_new_pi_) {
+      pi_ = new_pi_;
+
+    } else if (new_pi_ != pi_) {
+      stats_.num_dropped ++;
+      return false;
     }
   }
 
-  printf("}");
+  // Groups from a BlockStream are already filtered, but not hex input
+  if (is_type_c ? !filter_.isWantedPI(followed_pi_) :
+      !filter_.isDecoded(blockbits)) {
+    stats_.num_dropped ++;
+    return false;
+  }
+  const bool is_line_wanted = is_type_c || filter_.isWanted(blockbits);
+
+  uint64_t start_cycles = (use_cycle_counter_ ? readCycleCounter() : 0);
+
+  Group group(blockbits);
 
+  if (group.num_blocks < 2 || is_type_c)
+    stats_.num_untyped ++;
+  else
+    stats_.num_groups[group.type.code()] ++;
+
+  if (time_base_ != TIME_NONE && sample >= 0) {
+    // A single CT may be a miscorrection, so the origin is only taken once
+    // two of them agree
+    double ct;
+    if (!has_time_origin_ && !is_type_c && decodeClockTime(group, &ct)) {
+      double origin = ct - (sample + kCTGroupSamples) / kMPXRate;
+      if (has_ct_origin_ &&
+          std::fabs(origin - ct_origin_) <= kMaxCTOriginError) {
+        time_origin_ = ct_origin_;
+        has_time_origin_ = true;
+      }
+      ct_origin_ = origin;
+      has_ct_origin_ = true;
+    }
+    if (has_time_origin_)
+      group.rx_time = time_origin_ + sample / kMPXRate;
+  }
+
+  if (output_type_ == OUTPUT_HEX) {
+    // As in RDS Spy logs
+    std::string suffix = tag_;
+    if (group.rx_time >= 0.0)
+      suffix = "@" + formatTime(group.rx_time, "%Y/%m/%d %H:%M:%S", 2) +
+        (tag_.empty() ? "" : " " + tag_);
+    *line = (is_line_wanted ? group.toHex(suffix) : "");
+  } else {
+    Station& station = stations_.get(pi_);
+    stats_.num_evicted_stations = stations_.getNumEvictions();
+    if (is_type_c)
+      station.updateTypeC(group);
+    else
+      station.update(group, is_line_wanted);
+    *line = station.getJSON();
+  }
+
+  if (use_cycle_counter_)
+    stats_.cycles += readCycleCounter() - start_cycles;
+
+  return true;
+}
+
+const Station& GroupHandler::getStation() const {
+  return stations_.at(pi_);
+}
+
+const GroupStats& GroupHandler::getStats() const {
+  return stats_;
+}
+
+uint16_t GroupHandler::getPI() const {
+  return pi_;
+}
+
+void GroupHandler::followPI(uint16_t pi) {
+  followed_pi_ = pi;
 }
 
+
+
 } // namespace redsea
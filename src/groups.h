@@ -1,12 +1,17 @@
 #ifndef GROUPS_H_
 #define GROUPS_H_
 
-#include <map>
+#include <functional>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
+#include "common.h"
+#include "delta.h"
+#include "oda.h"
 #include "rdsstring.h"
-#include "tmc.h"
+#include "stats.h"
 
 namespace redsea {
 
@@ -22,6 +27,8 @@ class GroupType {
   bool operator==(const GroupType& other);
 
   std::string toString();
+  // The 5-bit type code, as in block 2 (e.g. 3A = 6)
+  int code() const;
 
   const uint16_t num;
   const uint16_t ab;
@@ -32,7 +39,7 @@ bool operator<(const GroupType& obj1, const GroupType& obj2);
 class Group {
   public:
   Group(std::vector<uint16_t> blockbits);
-  void printHex() const;
+  std::string toHex(std::string suffix="") const;
 
   GroupType type;
   int num_blocks;
@@ -40,19 +47,65 @@ class Group {
   uint16_t block2;
   uint16_t block3;
   uint16_t block4;
+  // Wall-clock time of the first bit (-T), or negative if not known
+  double rx_time;
 
 };
 
+// Radio paging codes from the slow labelling groups
+struct PagerInfo {
+  PagerInfo() : pac(0), opc(0), tng(0), ecc(0), ccf(0), interval(0) {}
+  int pac;
+  int opc;
+  int tng;
+  int ecc;
+  int ccf;
+  int interval;
+};
+
+// State only kept for snapshots (-S)
+struct SnapshotInfo {
+  SnapshotInfo() : alt_freqs(), num_groups(0), group_counts() {}
+  // The last complete list
+  std::set<double> alt_freqs;
+  // Since the last snapshot
+  unsigned num_groups;
+  unsigned group_counts[32];
+};
+
+// An Open Data Application announced by a station; the handler is null if
+// redsea doesn't decode it
+struct ODAApp {
+  uint16_t aid;
+  std::unique_ptr<ODAHandler> handler;
+};
+
+// The decoding state of one station. Fields that every group touches come
+// first; the ODA and paging decoders are allocated on first use, since most
+// stations never send them.
 class Station {
   public:
     Station();
-    Station(uint16_t pi);
-    void update(Group);
+    Station(uint16_t pi, std::string tag="",
+        const Options& options=Options());
+    // Without is_line_wanted, only the state is updated (for the groups
+    // that others depend on, see GroupFilter)
+    void update(Group, bool is_line_wanted=true);
+    // An RDS2 Type C group, which has no PI or group type
+    void updateTypeC(Group);
     bool hasPS() const;
+    bool hasRT() const;
     std::string getPS() const;
     std::string getRT() const;
     uint16_t getPI() const;
+    int getPTY() const;
     std::string getCountryCode() const;
+    // The JSON line for the last group, with its newline; empty if the
+    // group brought nothing new in delta mode, and always in snapshot mode
+    std::string getJSON() const;
+    // The snapshot record (-S) of the station's state and of the groups
+    // since the last one; false if there were none
+    bool writeSnapshot(double time, std::string* json);
   private:
     void decodeType0(Group);
     void decodeType1(Group);
@@ -64,47 +117,161 @@ class Station {
     void addAltFreq(uint8_t);
     void updatePS(int pos, std::vector<int> chars);
     void updateRadioText(int pos, std::vector<int> chars);
-    void parseRadioTextPlus(Group);
+    PagerInfo& getPager();
+    std::string* output();
+    bool isSelected(const char* key) const;
+    std::string* output(const char* key);
+    size_t beginLine(const Group& group);
+    void finishLine(size_t head_length);
+
+    // Decoders indexed by group type code
+    typedef void (Station::*GroupDecoder)(Group);
+    static const GroupDecoder kGroupDecoders[32];
+
+    // Used by every group, kept together at the front
     uint16_t pi_;
-    RDSString ps_;
-    RDSString rt_;
-    int rt_ab_;
-    int pty_;
+    uint8_t pty_;
+    uint8_t rt_ab_;
     bool is_tp_;
     bool is_ta_;
     bool is_music_;
+    bool has_country_;
+    RDSString ps_;
+    RDSString rt_;
+    std::string json_;
+    std::string tag_;
+
     std::set<double> alt_freqs_;
     int num_alt_freqs_;
-    int pin_;
-    int ecc_;
-    int cc_;
-    int tmc_id_;
-    int ews_channel_;
-    int lang_;
-    int linkage_la_;
+    uint16_t pin_;
+    uint16_t tmc_id_;
+    uint16_t ews_channel_;
+    uint8_t ecc_;
+    uint8_t cc_;
+    uint8_t lang_;
+    bool linkage_la_;
     std::string clock_time_;
-    bool has_country_;
-    std::map<GroupType,uint16_t> oda_app_for_group_;
-    bool has_rt_plus_;
-    bool rt_plus_cb_;
-    uint16_t rt_plus_scb_;
-    uint16_t rt_plus_template_num_;
+    // Index+1 into oda_apps_ by group type code, or 0
+    uint8_t oda_app_for_group_[32];
+
+    // Only allocated once the station is seen using them
+    std::vector<ODAApp> oda_apps_;
+    std::unique_ptr<PagerInfo> pager_;
+    std::unique_ptr<DeltaEncoder> delta_;
+    std::unique_ptr<SnapshotInfo> snapshot_;
+    // Selected JSON members (-f)
+    std::unique_ptr<std::set<std::string>> fields_;
+    bool is_line_wanted_;
 
-    int pager_pac_;
-    int pager_opc_;
-    int pager_tng_;
-    int pager_ecc_;
-    int pager_ccf_;
-    int pager_interval_;
+};
+
+// The largest -m; the index is hashed from the 16-bit PI and kept at most
+// half full
+const int kMaxStationLimit = 0x8000;
 
-    tmc::TMC tmc_;
+// Stations by PI code, at most options.max_stations of them. The PI is
+// hashed into a small open-addressed index of slots in a flat array; when
+// all slots are taken, the station that has gone longest without a group is
+// evicted. The slots are also linked in order of use, so that it is found
+// without a scan.
+class StationTable {
+  public:
+    StationTable(const Options& options, std::string tag="");
+    // Finds the station for the PI, or creates one
+    Station& get(uint16_t pi);
+    const Station& at(uint16_t pi) const;
+    size_t getNumEvictions() const;
+    void forEach(std::function<void(Station&)> function);
+  private:
+    size_t hash(uint16_t pi) const;
+    size_t findPosition(uint16_t pi) const;
+    void removeFromIndex(uint16_t pi);
+    void unlinkSlot(int slot);
+    void linkNewest(int slot);
 
+    const size_t max_size_;
+    std::string tag_;
+    const Options options_;
+    int index_bits_;
+    std::vector<int> index_;
+    std::vector<Station> stations_;
+    // Neighbours of each slot in the order of use
+    std::vector<int> newer_;
+    std::vector<int> older_;
+    int newest_;
+    int oldest_;
+    size_t num_evictions_;
 };
 
-struct RTPlusTag {
-  uint16_t content_type;
-  uint16_t start;
-  uint16_t length;
+// Confirms the PI code of incoming groups and passes them on to the
+// corresponding Station. The optional tag identifies the source of the
+// groups (e.g. "freq":"98.4") and is printed as a JSON member, or at the end
+// of the line in hex output.
+class GroupHandler {
+  public:
+    GroupHandler(const Options& options=Options(), std::string tag_key="",
+        std::string tag="");
+    // Decodes a group and prints its line to stdout. The sample is the input
+    // sample index of the group's first bit (see GroupInfo), or -1.
+    void handle(std::vector<uint16_t> blockbits, int64_t sample=-1);
+    // Decodes a group into an output line; false if the group was dropped
+    // for not matching the confirmed PI code or the filter (-p, -t). The
+    // line can be empty in delta mode, with field selection (-f), and for
+    // the groups that the filter only lets through for their state.
+    bool decode(std::vector<uint16_t> blockbits, std::string* line,
+        int64_t sample=-1);
+    // The station of the last decoded group (JSON output only)
+    const Station& getStation() const;
+    const GroupStats& getStats() const;
+    // Snapshot mode (-S): the time of the input in seconds. Snapshots that
+    // are due get printed. Without it, time is counted in groups.
+    void updateClock(double seconds);
+    // Counts a group (done by handle()) for the snapshot clock, when there
+    // is no input clock
+    void countGroup();
+    // Called with each snapshot instead of printing it
+    void setSnapshotHandler(
+        const std::function<void(const std::string& json)>& handler);
+    // Prints the last snapshots, and how many stations were evicted
+    void endInput();
+    // Called with the eviction report instead of printing it on stderr
+    void setDiagnosticHandler(
+        const std::function<void(const std::string& line)>& handler);
+    // The confirmed PI code, or 0
+    uint16_t getPI() const;
+    // For the RDS2 data streams, whose Type C groups have no PI: groups are
+    // taken to be of this station (as confirmed on stream 0) instead of one
+    // confirmed from their own block A. Block A decides the group's format:
+    // Type A or B if it is the PI, and Type C otherwise. Until the PI is
+    // known (0), it is confirmed from block A as usual.
+    void followPI(uint16_t pi);
+  private:
+    void printSnapshots();
+
+    eOutputType output_type_;
+    std::string tag_;
+    const double snapshot_interval_;
+    double clock_;
+    double next_snapshot_;
+    bool has_input_clock_;
+    std::function<void(const std::string& json)> snapshot_handler_;
+    const GroupFilter filter_;
+    const eTimeBase time_base_;
+    // Wall-clock time at input sample 0, once known
+    double time_origin_;
+    bool has_time_origin_;
+    // As given by the last CT group, until another one confirms it
+    double ct_origin_;
+    bool has_ct_origin_;
+    uint16_t pi_;
+    uint16_t prev_new_pi_;
+    uint16_t new_pi_;
+    uint16_t followed_pi_;
+    StationTable stations_;
+    const int max_stations_;
+    std::function<void(const std::string& line)> diagnostic_handler_;
+    const bool use_cycle_counter_;
+    GroupStats stats_;
 };
 
 } // namespace redsea
@@ -1,12 +1,27 @@
 #include "liquid_wrappers.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <complex>
 
 #include "liquid/liquid.h"
 
 namespace liquid {
 
+void designKaiserFilter(int len, float fc, std::vector<float>* taps,
+    float As, float mu) {
+
+  assert (fc >= 0.0f && fc <= 0.5f);
+
+  taps->resize(len);
+  liquid_firdes_kaiser(len, fc, As, mu, taps->data());
+
+  for (float& h : *taps)
+    h *= 2.0f * fc;
+
+}
+
 AGC::AGC(float bw) {
   object_ = agc_crcf_create();
   agc_crcf_set_bandwidth(object_, bw);
@@ -16,6 +31,18 @@ AGC::~AGC() {
   agc_crcf_destroy(object_);
 }
 
+void AGC::setBandwidth(float bw) {
+  agc_crcf_set_bandwidth(object_, bw);
+}
+
+void AGC::setGain(float gain) {
+  agc_crcf_set_gain(object_, gain);
+}
+
+float AGC::getGain() const {
+  return agc_crcf_get_gain(object_);
+}
+
 std::complex<float> AGC::execute(std::complex<float> s) {
   std::complex<float> result;
   agc_crcf_execute(object_, s, &result);
@@ -76,6 +103,10 @@ void NCO::step() {
   nco_crcf_step(object_);
 }
 
+void NCO::setFrequency(float freq) {
+  nco_crcf_set_frequency(object_, freq);
+}
+
 void NCO::setPLLBandwidth(float bw) {
   nco_crcf_pll_set_bandwidth(object_, bw);
 }
@@ -134,4 +165,83 @@ float Modem::getPhaseError() {
   return modem_get_demodulator_phase_error(object_);
 }
 
+PFBChannelizer::PFBChannelizer(unsigned num_channels, unsigned m, float As) :
+  object_(firpfbch2_crcf_create_kaiser(LIQUID_ANALYZER, num_channels, m, As)),
+  num_channels_(num_channels) {
+
+  assert (num_channels % 2 == 0);
+
+}
+
+PFBChannelizer::~PFBChannelizer() {
+  firpfbch2_crcf_destroy(object_);
+}
+
+std::vector<std::complex<float>> PFBChannelizer::execute(
+    std::vector<std::complex<float>> in) {
+
+  assert (in.size() == num_channels_ / 2);
+
+  std::vector<std::complex<float>> result(num_channels_);
+  firpfbch2_crcf_execute(object_, in.data(), result.data());
+
+  return result;
+}
+
+FMDemod::FMDemod(float kf) : object_(freqdem_create(kf)) {
+
+}
+
+FMDemod::~FMDemod() {
+  freqdem_destroy(object_);
+}
+
+float FMDemod::demodulate(std::complex<float> sample) {
+  float result;
+  freqdem_demodulate(object_, sample, &result);
+  return result;
+}
+
+void FMDemod::reset() {
+  freqdem_reset(object_);
+}
+
+Resampler::Resampler(float ratio, float As) :
+  object_(msresamp_rrrf_create(ratio, As)), ratio_(ratio) {
+
+}
+
+Resampler::~Resampler() {
+  msresamp_rrrf_destroy(object_);
+}
+
+std::vector<float> Resampler::execute(std::vector<float> in) {
+  std::vector<float> result(std::ceil(in.size() * ratio_) + 16);
+  unsigned n_out = 0;
+  msresamp_rrrf_execute(object_, in.data(), in.size(), result.data(), &n_out);
+  result.resize(n_out);
+  return result;
+}
+
+void Resampler::reset() {
+  msresamp_rrrf_reset(object_);
+}
+
+FFT::FFT(int len) : in_(len), out_(len),
+  object_(fft_create_plan(len, in_.data(), out_.data(), LIQUID_FFT_FORWARD,
+        0)) {
+
+}
+
+FFT::~FFT() {
+  fft_destroy_plan(object_);
+}
+
+std::vector<std::complex<float>> FFT::execute(
+    const std::vector<std::complex<float>>& in) {
+  std::copy(in.begin(), in.end(), in_.begin());
+  fft_execute(object_);
+  return out_;
+}
+
 } // namespace liquid
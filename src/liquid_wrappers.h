@@ -8,12 +8,19 @@
 
 namespace liquid {
 
+// Same taps as used by FIRFilter, for filters implemented outside liquid
+void designKaiserFilter(int len, float fc, std::vector<float>* taps,
+    float As=60.0f, float mu=0.0f);
+
 class AGC {
 
   public:
   AGC(float bw);
   ~AGC();
   std::complex<float> execute(std::complex<float> s);
+  void setBandwidth(float bw);
+  void setGain(float gain);
+  float getGain() const;
 
   private:
   agc_crcf object_;
@@ -42,6 +49,7 @@ class NCO {
   void mixBlockDown(std::complex<float>* x, std::complex<float>* y,
       int n);
   void step();
+  void setFrequency(float freq);
   void setPLLBandwidth(float);
   void stepPLL(float dphi);
 
@@ -74,6 +82,58 @@ class Modem {
     modem object_;
 };
 
+// Oversampled polyphase filterbank channelizer: for every num_channels/2
+// input samples, one sample is produced for each of the num_channels channels
+class PFBChannelizer {
+  public:
+    PFBChannelizer(unsigned num_channels, unsigned m=4, float As=60.0f);
+    ~PFBChannelizer();
+    std::vector<std::complex<float>> execute(
+        std::vector<std::complex<float>> in);
+
+  private:
+    firpfbch2_crcf object_;
+    unsigned num_channels_;
+};
+
+class FMDemod {
+  public:
+    FMDemod(float kf);
+    ~FMDemod();
+    float demodulate(std::complex<float> sample);
+    // Forgets the previous sample, e.g. after a gap in the input
+    void reset();
+
+  private:
+    freqdem object_;
+};
+
+class Resampler {
+  public:
+    Resampler(float ratio, float As=60.0f);
+    ~Resampler();
+    std::vector<float> execute(std::vector<float> in);
+    // Clears the filter history, e.g. after a gap in the input
+    void reset();
+
+  private:
+    msresamp_rrrf object_;
+    float ratio_;
+};
+
+class FFT {
+  public:
+    FFT(int len);
+    ~FFT();
+    std::vector<std::complex<float>> execute(
+        const std::vector<std::complex<float>>& in);
+
+  private:
+    std::vector<std::complex<float>> in_;
+    std::vector<std::complex<float>> out_;
+    fftplan object_;
+};
+
 } // namespace liquid
 
 #endif // LIQUID_WRAPPERS_H_
@@ -0,0 +1,100 @@
+#include "oda.h"
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "groups.h"
+#include "tables.h"
+#include "util.h"
+
+namespace redsea {
+
+const char* TMCHandler::getJSONKey() const {
+  return "tmc";
+}
+
+void TMCHandler::announce(uint16_t message, std::string* json) {
+  tmc_.systemGroup(message, json);
+}
+
+void TMCHandler::decode(const Group& group, const Station&,
+    std::string* json) {
+  tmc_.userGroup(bits(group.block2, 0, 5), group.block3, group.block4, json);
+}
+
+RTPlusHandler::RTPlusHandler() : cb_(false), scb_(0), template_num_(0),
+  is_item_running_(false), items_() {
+
+}
+
+const char* RTPlusHandler::getJSONKey() const {
+  return "radiotext_plus";
+}
+
+void RTPlusHandler::announce(uint16_t message, std::string*) {
+  cb_ = bits(message, 12, 1);
+  scb_ = bits(message, 8, 4);
+  template_num_ = bits(message, 0, 8);
+}
+
+void RTPlusHandler::decode(const Group& group, const Station& station,
+    std::string* json) {
+  //bool item_toggle  = bits(group.block2, 4, 1);
+  bool item_running = bits(group.block2, 3, 1);
+  is_item_running_ = item_running;
+
+  appendf(json, ",\"radiotext_plus\":{\"item_running\":\"%s\"",
+      item_running ? "true" : "false");
+
+  std::vector<RTPlusTag> tags(2);
+
+  tags[0].content_type = (bits(group.block2, 0, 3) << 3) +
+                          bits(group.block3, 13, 3);
+  tags[0].start  = bits(group.block3, 7, 6);
+  tags[0].length = bits(group.block3, 1, 6) + 1;
+
+  tags[1].content_type = (bits(group.block3, 0, 1) << 5) +
+                          bits(group.block4, 11, 5);
+  tags[1].start  = bits(group.block4, 5, 6);
+  tags[1].length = bits(group.block4, 0, 5) + 1;
+
+  std::string rt = station.getRT();
+
+  for (RTPlusTag tag : tags) {
+    if (rt.length() >= tag.start + tag.length && tag.length > 1) {
+      std::string name = getRTPlusContentTypeName(tag.content_type);
+      std::string text = rt.substr(tag.start, tag.length);
+      appendf(json, ",\"%s\":\"%s\"", name.c_str(), text.c_str());
+      items_[name] = text;
+    }
+  }
+
+  appendf(json, "}");
+
+}
+
+void RTPlusHandler::writeSnapshot(std::string* json) const {
+  if (items_.empty())
+    return;
+
+  appendf(json, ",\"radiotext_plus\":{\"item_running\":\"%s\"",
+      is_item_running_ ? "true" : "false");
+  for (const auto& item : items_)
+    appendf(json, ",\"%s\":\"%s\"", item.first.c_str(), item.second.c_str());
+  appendf(json, "}");
+}
+
+std::unique_ptr<ODAHandler> createODAHandler(uint16_t aid) {
+  static const std::map<uint16_t, std::function<ODAHandler*()>> registry = {
+    {0xCD46, []() { return new TMCHandler(); }},
+    {0xCD47, []() { return new TMCHandler(); }},
+    {0x4BD7, []() { return new RTPlusHandler(); }}
+  };
+
+  auto it = registry.find(aid);
+  return std::unique_ptr<ODAHandler>(it == registry.end() ? nullptr :
+      it->second());
+}
+
+} // namespace redsea
@@ -0,0 +1,72 @@
+#ifndef ODA_H_
+#define ODA_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "tmc.h"
+
+namespace redsea {
+
+class Group;
+class Station;
+
+struct RTPlusTag {
+  uint16_t content_type;
+  uint16_t start;
+  uint16_t length;
+};
+
+// Decoder for one Open Data Application, created for a station when it
+// announces the application's AID in group 3A
+class ODAHandler {
+  public:
+    virtual ~ODAHandler() {}
+    // The JSON member that announce() and decode() write, for -f
+    virtual const char* getJSONKey() const = 0;
+    // Block 3 of the announcement; JSON members go after "open_data_app"
+    virtual void announce(uint16_t message, std::string* json) = 0;
+    // A group of the type the application was announced on
+    virtual void decode(const Group& group, const Station& station,
+        std::string* json) = 0;
+    // The application's state as JSON members, for station snapshots
+    virtual void writeSnapshot(std::string*) const {}
+};
+
+// Traffic Message Channel (RDS-TMC: ALERT-C)
+class TMCHandler : public ODAHandler {
+  public:
+    const char* getJSONKey() const;
+    void announce(uint16_t message, std::string* json);
+    void decode(const Group& group, const Station& station,
+        std::string* json);
+  private:
+    tmc::TMC tmc_;
+};
+
+// RadioText Plus
+class RTPlusHandler : public ODAHandler {
+  public:
+    RTPlusHandler();
+    const char* getJSONKey() const;
+    void announce(uint16_t message, std::string* json);
+    void decode(const Group& group, const Station& station,
+        std::string* json);
+    void writeSnapshot(std::string* json) const;
+  private:
+    bool cb_;
+    uint16_t scb_;
+    uint16_t template_num_;
+    bool is_item_running_;
+    // The last text of each content type
+    std::map<std::string, std::string> items_;
+};
+
+// The handler for an AID, or nullptr if redsea doesn't decode it. New ODA
+// decoders are added to the registry in oda.cc.
+std::unique_ptr<ODAHandler> createODAHandler(uint16_t aid);
+
+} // namespace redsea
+#endif // ODA_H_
@@ -0,0 +1,81 @@
+#include "rds2.h"
+
+#include <cstdio>
+#include <string>
+
+namespace redsea {
+
+namespace {
+
+const int kNumStreams = 4;
+
+}
+
+RDS2Decoder::RDS2Decoder(const Options& options) : mpx_(kMPXChunkSize),
+  block_streams_(kNumStreams), group_handlers_(kNumStreams),
+  groups_(kNumStreams), group_info_(kNumStreams), workers_(kNumStreams) {
+
+  for (int s=0; s<kNumStreams; s++) {
+    block_streams_[s] = new BlockStream(options, s);
+    group_handlers_[s] = new GroupHandler(options, "stream", std::to_string(s));
+  }
+
+}
+
+RDS2Decoder::~RDS2Decoder() {
+  for (BlockStream* block_stream : block_streams_)
+    delete block_stream;
+  for (GroupHandler* group_handler : group_handlers_)
+    delete group_handler;
+}
+
+bool RDS2Decoder::readChunk() {
+
+  mpx_.resize(kMPXChunkSize);
+  size_t samplesread = fread(mpx_.data(), sizeof(int16_t), mpx_.size(),
+      stdin);
+  mpx_.resize(samplesread);
+
+  return samplesread > 0;
+}
+
+void RDS2Decoder::run() {
+
+  while (readChunk()) {
+
+    workers_.run(kNumStreams, [this](unsigned s) {
+      block_streams_[s]->pushSamples(mpx_);
+      while (block_streams_[s]->hasGroup()) {
+        GroupInfo info;
+        groups_[s].push_back(block_streams_[s]->popGroup(&info));
+        group_info_[s].push_back(info);
+      }
+    });
+
+    // Printed from the main thread so that output lines never interleave.
+    // The data streams take the PI confirmed on stream 0.
+    for (int s=0; s<kNumStreams; s++) {
+      if (s > 0)
+        group_handlers_[s]->followPI(group_handlers_[0]->getPI());
+      for (size_t i=0; i<groups_[s].size(); i++)
+        group_handlers_[s]->handle(groups_[s][i],
+                                   group_info_[s][i].start_sample);
+      groups_[s].clear();
+      group_info_[s].clear();
+    }
+
+  }
+
+  for (int s=0; s<kNumStreams; s++) {
+    block_streams_[s]->endInput();
+    while (block_streams_[s]->hasGroup()) {
+      GroupInfo info;
+      std::vector<uint16_t> group = block_streams_[s]->popGroup(&info);
+      group_handlers_[s]->handle(group, info.start_sample);
+    }
+    group_handlers_[s]->endInput();
+  }
+
+}
+
+} // namespace redsea
@@ -0,0 +1,34 @@
+#ifndef RDS2_H_
+#define RDS2_H_
+
+#include <vector>
+
+#include "block_sync.h"
+#include "common.h"
+#include "groups.h"
+#include "worker_pool.h"
+
+namespace redsea {
+
+// Decodes the main RDS stream and the three RDS2 data streams (on the 66.5,
+// 71.25 and 76 kHz subcarriers) of an MPX signal. The MPX is read once and
+// each stream is demodulated and synchronized on its own worker thread.
+class RDS2Decoder {
+  public:
+    RDS2Decoder(const Options& options);
+    ~RDS2Decoder();
+    void run();
+
+  private:
+    bool readChunk();
+
+    std::vector<int16_t> mpx_;
+    std::vector<BlockStream*> block_streams_;
+    std::vector<GroupHandler*> group_handlers_;
+    std::vector<std::vector<std::vector<uint16_t>>> groups_;
+    std::vector<std::vector<GroupInfo>> group_info_;
+    WorkerPool workers_;
+};
+
+} // namespace redsea
+#endif // RDS2_H_
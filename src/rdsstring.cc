@@ -15,7 +15,8 @@ std::string rtrim(std::string s) {
 }
 
 RDSString::RDSString(int len) : chars_(len), is_char_sequential_(len),
-  prev_pos_(-1), last_complete_string_(getString()) {
+  prev_pos_(-1), length_received_(0), length_expected_(len),
+  has_changed_(false), last_complete_string_(getString()) {
 
 }
 
@@ -23,53 +24,64 @@ void RDSString::setAt(int pos, int chr) {
   if (pos < 0 || pos >= (int)chars_.size())
     return;
 
-  chars_[pos] = chr;
+  if (chars_[pos] != chr) {
+    int prev_chr = chars_[pos];
+    chars_[pos] = chr;
+    has_changed_ = true;
 
+    if (chr == 0x0D && size_t(pos) < length_expected_)
+      length_expected_ = pos;
+    else if (prev_chr == 0x0D && size_t(pos) == length_expected_)
+      findTerminator(pos + 1);
+  }
+
+  // The sequential characters are always one run, as any jump starts a new
+  // one; it only counts as received if it started at 0
   if (pos != prev_pos_ + 1) {
     for (size_t i=0; i<is_char_sequential_.size(); i++)
       is_char_sequential_[i] = false;
+    length_received_ = 0;
   }
 
   is_char_sequential_[pos] = true;
+  if (size_t(pos) == length_received_)
+    length_received_++;
 
-  if (isComplete())
+  if (isComplete() && has_changed_) {
     last_complete_string_ = getString();
+    has_changed_ = false;
+  }
 
   prev_pos_ = pos;
 
 }
 
-size_t RDSString::lengthReceived() const {
-
-  size_t result = 0;
-  for (size_t i=0; i<is_char_sequential_.size(); i++) {
-    if (!is_char_sequential_[i])
+void RDSString::findTerminator(size_t from) {
+  length_expected_ = chars_.size();
+  for (size_t i=from; i<chars_.size(); i++) {
+    if (chars_[i] == 0x0D) {
+      length_expected_ = i;
       break;
-    result = i+1;
+    }
   }
+}
 
-  return result;
+size_t RDSString::lengthReceived() const {
+  return length_received_;
 }
 
 size_t RDSString::lengthExpected() const {
-
-  size_t result = chars_.size();
-
-  for (size_t i=0; i<chars_.size(); i++) {
-    if (chars_[i] == 0x0D) {
-      result = i;
-      break;
-    }
-  }
-
-  return result;
+  return length_expected_;
 }
 
 std::string RDSString::getString() const {
   std::string result;
-  size_t len = lengthExpected();
-  for (size_t i=0; i<len; i++) {
-    result += (is_char_sequential_[i] ? getLCDchar(chars_[i]) : " ");
+  result.reserve(length_expected_);
+  for (size_t i=0; i<length_expected_; i++) {
+    if (is_char_sequential_[i])
+      appendLCDchar(&result, chars_[i]);
+    else
+      result += ' ';
   }
 
   return result;
@@ -80,7 +92,7 @@ std::string RDSString::getTrimmedString() const {
   return rtrim(getString());
 }
 
-std::string RDSString::getLastCompleteString() const {
+const std::string& RDSString::getLastCompleteString() const {
   return last_complete_string_;
 }
 
@@ -96,7 +108,9 @@ void RDSString::clear() {
   for (size_t i=0; i<chars_.size(); i++) {
     is_char_sequential_[i] = false;
   }
+  length_received_ = 0;
   last_complete_string_ = getString();
+  has_changed_ = true;
 }
 
 } // namespace redsea
@@ -6,6 +6,9 @@
 
 namespace redsea {
 
+// A string (PS or RadioText) received a few characters at a time. The
+// received length and the terminator position are kept up to date on each
+// character, and the complete string is only rebuilt when it has changed.
 class RDSString {
   public:
   RDSString(int len=8);
@@ -14,15 +17,23 @@ class RDSString {
   size_t lengthExpected() const;
   std::string getString() const;
   std::string getTrimmedString() const;
-  std::string getLastCompleteString() const;
+  const std::string& getLastCompleteString() const;
   std::string getLastCompleteStringTrimmed() const;
   bool isComplete() const;
   void clear();
 
   private:
+  void findTerminator(size_t from);
+
   std::vector<int> chars_;
   std::vector<bool> is_char_sequential_;
   int prev_pos_;
+  // Sequential characters received from the start
+  size_t length_received_;
+  // Position of the first carriage return, or the full length
+  size_t length_expected_;
+  // Whether chars_ differs from last_complete_string_
+  bool has_changed_;
   std::string last_complete_string_;
 
 };
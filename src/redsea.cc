@@ -16,15 +16,30 @@
  *
  */
 
+#include <fcntl.h>
 #include <getopt.h>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 #include "block_sync.h"
+#include "channelizer.h"
+#include "daemon.h"
+#include "diversity.h"
 #include "groups.h"
+#include "rds2.h"
+#include "scan.h"
+#include "stats.h"
+#include "util.h"
 
 namespace redsea {
 
-void printShort(Station station) {
+// Bits read at most between stats updates (-M), about a second of signal,
+// so that the counters are written even when there is no RDS
+const int kStatsUpdateBits = 1187;
+
+void printShort(const Station& station) {
     printf("%s 0x%04x %s\n", station.getPS().c_str(), station.getPI(),
         station.getRT().c_str());
 
@@ -38,75 +53,309 @@ void printShort(Station station) {
 int main(int argc, char** argv) {
 
   int option_char;
-  redsea::eInputType input_type = redsea::INPUT_MPX;
-  int output_type = redsea::OUTPUT_JSON;
+  redsea::Options options;
 
-  while ((option_char = getopt(argc, argv, "bhx")) != EOF) {
+  while ((option_char = getopt(argc, argv,
+          "2bCc:D:def:Fghm:M:p:Pr:S:s:T:t:ux")) != EOF) {
     switch (option_char) {
+      case '2':
+        options.use_rds2 = true;
+        break;
       case 'b':
-        input_type = redsea::INPUT_ASCIIBITS;
+        options.input_type = redsea::INPUT_ASCIIBITS;
+        break;
+      case 'C':
+        options.use_fixed_point = true;
+        options.compare_fixed_point = true;
+        break;
+      case 'c':
+        options.is_wideband = true;
+        try {
+          options.center_freq = redsea::parseFrequency(optarg);
+        } catch (const std::exception&) {
+          std::cerr << "invalid center frequency: " << optarg << std::endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'D':
+        options.control_path = optarg;
+        break;
+      case 'd':
+        options.use_diversity = true;
+        break;
+      case 'e':
+        options.use_equalizer = true;
+        break;
+      case 'f':
+        options.fields = redsea::split(optarg, ',');
+        break;
+      case 'F':
+        options.use_fixed_point = true;
+        break;
+      case 'g':
+        options.use_rds_gate = true;
         break;
       case 'h':
-        input_type = redsea::INPUT_RDSSPY;
+        options.input_type = redsea::INPUT_RDSSPY;
+        break;
+      case 'm':
+        try {
+          options.max_stations = std::stoi(optarg);
+        } catch (const std::exception&) {
+          options.max_stations = 0;
+        }
+        if (options.max_stations < 1 ||
+            options.max_stations > redsea::kMaxStationLimit) {
+          std::cerr << "invalid station limit: " << optarg << " (1 to " <<
+            redsea::kMaxStationLimit << ")" << std::endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'M':
+        options.stats_path = optarg;
+        break;
+      case 'p':
+        for (std::string pi : redsea::split(optarg, ',')) {
+          size_t idx = 0;
+          unsigned long value = 0x10000;
+          try {
+            value = std::stoul(pi, &idx, 16);
+          } catch (const std::exception&) {
+          }
+          if (idx < pi.length() || value > 0xFFFF) {
+            std::cerr << "invalid PI code: " << pi << std::endl;
+            return EXIT_FAILURE;
+          }
+          options.filter.pis.push_back(value);
+        }
+        break;
+      case 'P':
+        options.use_pilot = true;
+        break;
+      case 'r':
+        try {
+          options.sample_rate = redsea::parseFrequency(optarg);
+        } catch (const std::exception&) {
+          options.sample_rate = 0.0;
+        }
+        if (options.sample_rate <= 0.0) {
+          std::cerr << "invalid sample rate: " << optarg << std::endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'S':
+        try {
+          options.snapshot_interval = std::stod(optarg);
+        } catch (const std::exception&) {
+          options.snapshot_interval = 0.0;
+        }
+        if (options.snapshot_interval <= 0.0) {
+          std::cerr << "invalid snapshot interval: " << optarg << std::endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 's':
+        try {
+          options.scan_fd = std::stoi(optarg);
+        } catch (const std::exception&) {
+          options.scan_fd = -1;
+        }
+        if (options.scan_fd < 0 || fcntl(options.scan_fd, F_GETFD) == -1) {
+          std::cerr << "invalid control file descriptor: " << optarg <<
+            std::endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'T':
+        if (std::string(optarg) == "ct") {
+          options.time_base = redsea::TIME_CT;
+        } else {
+          try {
+            options.start_time = redsea::parseTime(optarg);
+            options.time_base = redsea::TIME_START;
+          } catch (const std::exception&) {
+            std::cerr << "invalid start time: " << optarg << std::endl;
+            return EXIT_FAILURE;
+          }
+        }
+        break;
+      case 't':
+        // 8A, 8B, or 8 for both versions
+        options.filter.type_mask = 0;
+        for (std::string type : redsea::split(optarg, ',')) {
+          size_t idx = 0;
+          int num = 16;
+          try {
+            num = std::stoi(type, &idx);
+          } catch (const std::exception&) {
+          }
+          uint32_t versions = 3;
+          if (idx + 1 == type.length() &&
+              (type[idx] == 'A' || type[idx] == 'B'))
+            versions = (type[idx++] == 'A' ? 1 : 2);
+          if (idx < type.length() || num < 0 || num > 15) {
+            std::cerr << "invalid group type: " << type << std::endl;
+            return EXIT_FAILURE;
+          }
+          options.filter.type_mask |= versions << (num << 1);
+        }
+        break;
+      case 'u':
+        options.use_delta_output = true;
         break;
       case 'x':
-        output_type = redsea::OUTPUT_HEX;
+        options.output_type = redsea::OUTPUT_HEX;
         break;
       case '?':
         break;
     }
   }
 
-  redsea::BlockStream block_stream(input_type);
-  std::map<uint16_t, redsea::Station> stations;
+  // Change-only output compares JSON members
+  if (options.use_delta_output && options.output_type == redsea::OUTPUT_HEX) {
+    std::cerr << "-u can't be used with -x" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  uint16_t pi=0, prev_new_pi=0, new_pi=0;
+  // Snapshots are JSON records
+  if (options.snapshot_interval > 0.0 &&
+      options.output_type == redsea::OUTPUT_HEX) {
+    std::cerr << "-S can't be used with -x" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  int group_counter = 0;
-  bool is_eof = false;
+  // The fixed-point chain has no equalizer
+  if (options.use_equalizer && options.use_fixed_point) {
+    std::cerr << "-e can't be used with -F" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  while (!is_eof) {
+  // Scan output has the time since the retune instead
+  if (options.scan_fd >= 0 && options.time_base != redsea::TIME_NONE) {
+    std::cerr << "-T can't be used with -s" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-    std::vector<uint16_t> blockbits;
+  // Hex groups don't tell when they were received
+  if (options.input_type == redsea::INPUT_RDSSPY &&
+      options.time_base != redsea::TIME_NONE) {
+    std::cerr << "-T can't be used with -h" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-    if (input_type == redsea::INPUT_MPX ||
-        input_type == redsea::INPUT_ASCIIBITS) {
-      blockbits = block_stream.getNextGroup();
-      is_eof = block_stream.isEOF();
-    } else if (input_type == redsea::INPUT_RDSSPY) {
-      blockbits = redsea::getNextGroupRSpy();
-      is_eof = blockbits.size() == 0;
+  // These modes run a decoder chain per channel, input or stream
+  const bool is_mpx = (options.input_type == redsea::INPUT_MPX);
+  if (!options.stats_path.empty() && (options.is_wideband ||
+      !options.control_path.empty() || options.use_diversity ||
+      (is_mpx && (options.scan_fd >= 0 || options.use_rds2)))) {
+    std::cerr << "-M can't be used with -2, -c, -D, -d or -s" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (options.is_wideband) {
+    // The filterbank needs an even number of 200 kHz channels
+    if (std::fmod(options.sample_rate, 400000.0) != 0.0) {
+      std::cerr << "sample rate must be a multiple of 400 kHz" << std::endl;
+      return EXIT_FAILURE;
+    }
+    // SubcarrierBank mixes all stations down in lockstep, with no pilot PLL
+    if (options.use_pilot) {
+      std::cerr << "-P can't be used with -c" << std::endl;
+      return EXIT_FAILURE;
     }
+    redsea::Channelizer channelizer(options);
+    channelizer.run();
+    return EXIT_SUCCESS;
+  }
 
-    if (blockbits.size() == 0)
-      continue;
+  if (!options.control_path.empty()) {
+#ifdef HAVE_DAEMON
+    try {
+      redsea::Daemon daemon(options);
+      for (int i=optind; i<argc; i++) {
+        // NAME=PATH, or just PATH
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        std::string name = (eq == std::string::npos ? arg : arg.substr(0, eq));
+        std::string path = (eq == std::string::npos ? arg : arg.substr(eq+1));
+        std::string error;
+        if (!daemon.addStream(name, path, &error))
+          std::cerr << error << std::endl;
+      }
+      daemon.run();
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+#else
+    std::cerr << "daemon mode (-D) is only available on Linux" << std::endl;
+    return EXIT_FAILURE;
+#endif
+  }
 
-    group_counter ++;
+  if (options.use_diversity) {
+    if (optind >= argc) {
+      std::cerr << "-d needs the MPX files to combine" << std::endl;
+      return EXIT_FAILURE;
+    }
+    try {
+      redsea::DiversityCombiner combiner(options,
+          std::vector<std::string>(argv + optind, argv + argc));
+      combiner.run();
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
 
-    prev_new_pi = new_pi;
-    new_pi = blockbits[0];
+  if (options.scan_fd >= 0 && options.input_type == redsea::INPUT_MPX) {
+    redsea::Scanner scanner(options);
+    scanner.run();
+    return EXIT_SUCCESS;
+  }
 
-    if (new_pi == prev_new_pi) {
-      pi = new_pi;
+  if (options.use_rds2 && options.input_type == redsea::INPUT_MPX) {
+    redsea::RDS2Decoder rds2_decoder(options);
+    rds2_decoder.run();
+    return EXIT_SUCCESS;
+  }
 
-    } else if (new_pi != pi) {
-      continue;
-    }
+  redsea::BlockStream block_stream(options);
+  redsea::GroupHandler group_handler(options);
+  std::unique_ptr<redsea::StatsWriter> stats_writer(
+      options.stats_path.empty() ? nullptr :
+      new redsea::StatsWriter(options.stats_path));
 
-    redsea::Group group(blockbits);
+  bool is_eof = false;
 
-    if (output_type == redsea::OUTPUT_HEX) {
-      group.printHex();
-    } else {
+  while (!is_eof) {
 
-      if (stations.find(pi) != stations.end()) {
-        stations[pi].update(group);
-      } else {
-        stations.insert({pi, redsea::Station(pi)});
-        stations[pi].update(group);
-      }
+    std::vector<uint16_t> blockbits;
+    int64_t sample = -1;
+
+    if (options.input_type == redsea::INPUT_MPX ||
+        options.input_type == redsea::INPUT_ASCIIBITS) {
+      redsea::GroupInfo info;
+      blockbits = block_stream.getNextGroup(&info,
+          stats_writer ? redsea::kStatsUpdateBits : 0);
+      is_eof = block_stream.isEOF();
+      group_handler.updateClock(block_stream.getTime());
+      if (!blockbits.empty())
+        sample = info.start_sample;
+    } else if (options.input_type == redsea::INPUT_RDSSPY) {
+      blockbits = redsea::getNextGroupRSpy();
+      is_eof = blockbits.size() == 0;
     }
 
-    //printShort(stations[pi]);
+    group_handler.handle(blockbits, sample);
+
+    if (stats_writer)
+      stats_writer->update(block_stream.getDemodStats(),
+          block_stream.getSyncStats(), group_handler.getStats(), is_eof);
+
   }
+
+  group_handler.endInput();
 }
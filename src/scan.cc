@@ -0,0 +1,165 @@
+#include "scan.h"
+
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+
+#include "groups.h"
+#include "tables.h"
+#include "util.h"
+
+namespace redsea {
+
+namespace {
+
+// Small enough for the retune markers to be noticed within 10 ms
+const int kChunkSize = 2048;
+
+const unsigned kAllPSSegments = 0xF;
+
+}
+
+Scanner::Scanner(const Options& options) : options_(options),
+  control_fd_(options.scan_fd), control_buffer_(), block_stream_(),
+  label_(), samples_since_retune_(0), pi_(0), ps_chars_(8),
+  ps_segments_(0), is_identified_(false) {
+
+  retune("");
+
+}
+
+// Reads the retune markers that are waiting on the control descriptor, if
+// any. Once it has been closed, the input is decoded to its end on the last
+// frequency.
+void Scanner::pollControl() {
+
+  if (control_fd_ < 0)
+    return;
+
+  struct pollfd pfd = {control_fd_, POLLIN, 0};
+  bool is_retuned = false;
+  std::string label;
+
+  while (poll(&pfd, 1, 0) > 0) {
+    char buffer[256];
+    ssize_t bytesread = read(control_fd_, buffer, sizeof(buffer));
+    if (bytesread < 0 && errno == EINTR)
+      continue;
+    if (bytesread <= 0) {
+      control_fd_ = -1;
+      break;
+    }
+
+    control_buffer_.append(buffer, bytesread);
+
+    size_t newline;
+    while ((newline = control_buffer_.find('\n')) != std::string::npos) {
+      label = control_buffer_.substr(0, newline);
+      control_buffer_.erase(0, newline + 1);
+      is_retuned = true;
+    }
+  }
+
+  // Only the last of several markers matters
+  if (is_retuned)
+    retune(label);
+
+}
+
+void Scanner::retune(const std::string& label) {
+  block_stream_.reset(new BlockStream(options_));
+  label_ = label;
+  samples_since_retune_ = 0;
+  pi_ = 0;
+  ps_segments_ = 0;
+  is_identified_ = false;
+}
+
+void Scanner::run() {
+
+  std::vector<int16_t> samples;
+
+  while (true) {
+    pollControl();
+    samples.resize(kChunkSize);
+    size_t samplesread = fread(samples.data(), sizeof(samples[0]),
+        kChunkSize, stdin);
+    if (samplesread == 0)
+      break;
+    samples.resize(samplesread);
+    samples_since_retune_ += samplesread;
+
+    if (is_identified_)
+      continue;
+
+    block_stream_->pushSamples(samples);
+
+    // Reported as soon as block A has been received, before the rest of the
+    // group
+    if (pi_ == 0 && block_stream_->getPI() != 0) {
+      pi_ = block_stream_->getPI();
+      if (options_.output_type == OUTPUT_JSON)
+        print(false);
+    }
+
+    while (block_stream_->hasGroup() && !is_identified_)
+      handle(block_stream_->popGroup());
+  }
+
+}
+
+// BlockStream only sets the PI once in sync, so it's already confirmed by
+// the offset sequence
+void Scanner::handle(const std::vector<uint16_t>& blockbits) {
+
+  Group group(blockbits);
+
+  // BlockStream passes groups of unwanted types (-t) on as their block A
+  if (group.num_blocks == 0 || group.block1 != pi_ ||
+      !options_.filter.isWanted(blockbits))
+    return;
+
+  if (options_.output_type == OUTPUT_HEX) {
+    fputs(group.toHex(label_).c_str(), stdout);
+    fflush(stdout);
+  }
+
+  // PS segments in any order, which is faster than waiting for them to
+  // arrive in sequence
+  if (group.num_blocks == 4 && group.type.num == 0) {
+    int segment = bits(group.block2, 0, 2);
+    ps_chars_[segment * 2]     = bits(group.block4, 8, 8);
+    ps_chars_[segment * 2 + 1] = bits(group.block4, 0, 8);
+    ps_segments_ |= (1 << segment);
+
+    if (ps_segments_ == kAllPSSegments) {
+      if (options_.output_type == OUTPUT_JSON)
+        print(true);
+      is_identified_ = true;
+    }
+  }
+
+}
+
+// Flushed right away, as the scanner may be waiting for it to retune
+void Scanner::print(bool with_ps) const {
+
+  printf("{\"pi\":\"0x%04x\"", pi_);
+
+  if (with_ps) {
+    std::string ps;
+    for (int c : ps_chars_)
+      appendLCDchar(&ps, c);
+    printf(",\"ps\":\"%s\"", ps.c_str());
+  }
+
+  if (!label_.empty())
+    printf(",\"freq\":\"%s\"", label_.c_str());
+
+  printf(",\"time\":%.3f}\n", samples_since_retune_ / kMPXRate);
+  fflush(stdout);
+
+}
+
+} // namespace redsea
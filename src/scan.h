@@ -0,0 +1,45 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "block_sync.h"
+#include "common.h"
+
+namespace redsea {
+
+// Identifies stations for a scanner that retunes every few hundred ms. Each
+// line read from the control file descriptor marks a retune: all DSP and
+// sync state is reset, and the line is used as the label of the following
+// output. The PI is printed as soon as block A is received, and the PS once
+// all of its segments have been; after that the input is skipped until the
+// next retune. In hex output (-x), the groups are printed instead, tagged
+// with the label, until the PS is complete.
+class Scanner {
+  public:
+    Scanner(const Options& options);
+    void run();
+
+  private:
+    void pollControl();
+    void retune(const std::string& label);
+    void handle(const std::vector<uint16_t>& blockbits);
+    void print(bool with_ps) const;
+
+    const Options options_;
+    // -1 once closed
+    int control_fd_;
+    std::string control_buffer_;
+    std::unique_ptr<BlockStream> block_stream_;
+    std::string label_;
+    unsigned long long samples_since_retune_;
+    uint16_t pi_;
+    std::vector<int> ps_chars_;
+    unsigned ps_segments_;
+    bool is_identified_;
+};
+
+} // namespace redsea
+#endif // SCAN_H_
@@ -0,0 +1,171 @@
+#include "stats.h"
+
+#include <cstdio>
+#include <iostream>
+
+#include "groups.h"
+#include "util.h"
+
+namespace redsea {
+
+namespace {
+
+const std::chrono::seconds kStatsInterval(10);
+
+void appendMetric(std::string* text, const char* name, const char* help,
+    const char* type) {
+  appendf(text, "# HELP redsea_%s %s\n# TYPE redsea_%s %s\n", name, help,
+      name, type);
+}
+
+void appendValue(std::string* text, const char* name, const char* labels,
+    uint64_t value) {
+  appendf(text, "redsea_%s%s %llu\n", name, labels,
+      (unsigned long long)value);
+}
+
+void appendSeconds(std::string* text, const char* name, const char* labels,
+    double value) {
+  appendf(text, "redsea_%s%s %.6f\n", name, labels, value);
+}
+
+}
+
+StatsWriter::StatsWriter(const std::string& path) : path_(path),
+  start_time_(std::chrono::steady_clock::now()),
+  start_cycles_(readCycleCounter()),
+  next_write_(start_time_ + kStatsInterval) {
+
+}
+
+void StatsWriter::update(const DemodStats& demod, const SyncStats& sync,
+    const GroupStats& groups, bool is_final) {
+
+  std::chrono::steady_clock::time_point now =
+    std::chrono::steady_clock::now();
+  if (!is_final && now < next_write_)
+    return;
+
+  while (next_write_ <= now)
+    next_write_ += kStatsInterval;
+
+  // The counter's rate, measured over the whole run
+  double seconds = std::chrono::duration<double>(now - start_time_).count();
+  double cycles_per_second = (seconds > 0.0 ?
+      (readCycleCounter() - start_cycles_) / seconds : 0.0);
+
+  if (path_ == "-")
+    writeLine(demod, sync, groups, cycles_per_second);
+  else
+    writeFile(demod, sync, groups, cycles_per_second);
+}
+
+void StatsWriter::writeLine(const DemodStats& demod, const SyncStats& sync,
+    const GroupStats& groups, double cycles_per_second) const {
+
+  uint64_t num_groups = groups.num_untyped;
+  for (uint64_t n : groups.num_groups)
+    num_groups += n;
+
+  double scale = (cycles_per_second > 0.0 ? 1.0 / cycles_per_second : 0.0);
+
+  fprintf(stderr, "stats: %llu samples, %llu symbols, %llu bits; "
+      "blocks %llu ok, %llu corrected, %llu uncorrectable; "
+      "%llu clock slips, %llu syncs, %llu lost; %llu groups, %llu dropped; "
+      "%llu stations evicted; "
+      "cpu %.3f s demod, %.3f s sync, %.3f s groups\n",
+      (unsigned long long)demod.num_samples,
+      (unsigned long long)demod.num_symbols,
+      (unsigned long long)demod.num_bits,
+      (unsigned long long)sync.num_blocks_ok,
+      (unsigned long long)(sync.num_blocks_check_bits +
+                           sync.num_blocks_clock_slip +
+                           sync.num_blocks_burst_corrected +
+                           sync.num_blocks_soft_corrected),
+      (unsigned long long)sync.num_blocks_uncorrectable,
+      (unsigned long long)sync.num_blocks_clock_slip,
+      (unsigned long long)sync.num_acquisitions,
+      (unsigned long long)sync.num_losses,
+      (unsigned long long)num_groups,
+      (unsigned long long)groups.num_dropped,
+      (unsigned long long)groups.num_evicted_stations,
+      demod.cycles * scale, sync.cycles * scale, groups.cycles * scale);
+}
+
+void StatsWriter::writeFile(const DemodStats& demod, const SyncStats& sync,
+    const GroupStats& groups, double cycles_per_second) const {
+
+  std::string text;
+
+  appendMetric(&text, "samples_total", "MPX samples read.", "counter");
+  appendValue(&text, "samples_total", "", demod.num_samples);
+  appendMetric(&text, "symbols_total", "Biphase symbols demodulated.",
+      "counter");
+  appendValue(&text, "symbols_total", "", demod.num_symbols);
+  appendMetric(&text, "bits_total", "Bits demodulated.", "counter");
+  appendValue(&text, "bits_total", "", demod.num_bits);
+
+  appendMetric(&text, "blocks_total", "Blocks received in sync, by result.",
+      "counter");
+  appendValue(&text, "blocks_total", "{result=\"ok\"}", sync.num_blocks_ok);
+  appendValue(&text, "blocks_total", "{result=\"check_bits\"}",
+      sync.num_blocks_check_bits);
+  appendValue(&text, "blocks_total", "{result=\"clock_slip\"}",
+      sync.num_blocks_clock_slip);
+  appendValue(&text, "blocks_total", "{result=\"burst_corrected\"}",
+      sync.num_blocks_burst_corrected);
+  appendValue(&text, "blocks_total", "{result=\"soft_corrected\"}",
+      sync.num_blocks_soft_corrected);
+  appendValue(&text, "blocks_total", "{result=\"uncorrectable\"}",
+      sync.num_blocks_uncorrectable);
+
+  appendMetric(&text, "realignments_total",
+      "Block phase moved to a PI found while flywheeling.", "counter");
+  appendValue(&text, "realignments_total", "", sync.num_realignments);
+  appendMetric(&text, "sync_acquisitions_total", "Times sync was found.",
+      "counter");
+  appendValue(&text, "sync_acquisitions_total", "", sync.num_acquisitions);
+  appendMetric(&text, "sync_losses_total", "Times sync was lost.", "counter");
+  appendValue(&text, "sync_losses_total", "", sync.num_losses);
+
+  appendMetric(&text, "groups_total", "Groups decoded, by type.", "counter");
+  for (int code=0; code<32; code++) {
+    if (groups.num_groups[code] == 0)
+      continue;
+    std::string labels = "{type=\"" + GroupType(code).toString() + "\"}";
+    appendValue(&text, "groups_total", labels.c_str(),
+        groups.num_groups[code]);
+  }
+  appendValue(&text, "groups_total", "{type=\"none\"}", groups.num_untyped);
+  appendMetric(&text, "groups_dropped_total",
+      "Groups not matching the confirmed PI or the filter.", "counter");
+  appendValue(&text, "groups_dropped_total", "", groups.num_dropped);
+  appendMetric(&text, "stations_evicted_total",
+      "Stations forgotten to stay within the station limit.", "counter");
+  appendValue(&text, "stations_evicted_total", "",
+      groups.num_evicted_stations);
+
+  double scale = (cycles_per_second > 0.0 ? 1.0 / cycles_per_second : 0.0);
+  appendMetric(&text, "stage_cpu_seconds_total", "CPU time by stage.",
+      "counter");
+  appendSeconds(&text, "stage_cpu_seconds_total", "{stage=\"demod\"}",
+      demod.cycles * scale);
+  appendSeconds(&text, "stage_cpu_seconds_total", "{stage=\"sync\"}",
+      sync.cycles * scale);
+  appendSeconds(&text, "stage_cpu_seconds_total", "{stage=\"groups\"}",
+      groups.cycles * scale);
+
+  std::string temp_path = path_ + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "w");
+  if (file == nullptr) {
+    std::cerr << "can't write stats to " << temp_path << std::endl;
+    return;
+  }
+  fputs(text.c_str(), file);
+  fclose(file);
+
+  if (rename(temp_path.c_str(), path_.c_str()) != 0)
+    std::cerr << "can't write stats to " << path_ << std::endl;
+}
+
+} // namespace redsea
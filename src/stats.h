@@ -0,0 +1,93 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace redsea {
+
+// The time stamp counter, for the CPU time of each stage; nanoseconds where
+// there is none. Only read when stats are on (-M).
+inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Counters of each stage. They are always kept, since an increment costs
+// next to nothing; cycles are only counted with -M.
+struct DemodStats {
+  DemodStats() : num_samples(0), num_symbols(0), num_bits(0), cycles(0) {}
+  uint64_t num_samples;
+  uint64_t num_symbols;
+  uint64_t num_bits;
+  uint64_t cycles;
+};
+
+// Blocks are counted once in sync, in one of the six results
+struct SyncStats {
+  SyncStats() : num_blocks_ok(0), num_blocks_check_bits(0),
+    num_blocks_clock_slip(0), num_blocks_burst_corrected(0),
+    num_blocks_soft_corrected(0), num_blocks_uncorrectable(0),
+    num_realignments(0), num_acquisitions(0), num_losses(0), cycles(0) {}
+  uint64_t num_blocks_ok;
+  // PI received but the error was in the check bits
+  uint64_t num_blocks_check_bits;
+  // PI found a bit early or late (Section C.1.2)
+  uint64_t num_blocks_clock_slip;
+  uint64_t num_blocks_burst_corrected;
+  uint64_t num_blocks_soft_corrected;
+  uint64_t num_blocks_uncorrectable;
+  // Block phase moved to the PI found while flywheeling
+  uint64_t num_realignments;
+  uint64_t num_acquisitions;
+  uint64_t num_losses;
+  uint64_t cycles;
+};
+
+struct GroupStats {
+  GroupStats() : num_groups(), num_untyped(0), num_dropped(0),
+    num_evicted_stations(0), cycles(0) {}
+  // By group type code
+  uint64_t num_groups[32];
+  // Without block B, or RDS2 Type C
+  uint64_t num_untyped;
+  // Not matching the confirmed PI or the filter
+  uint64_t num_dropped;
+  // Forgotten to stay within the station limit (-m)
+  uint64_t num_evicted_stations;
+  uint64_t cycles;
+};
+
+// Writes the counters (-M) every kStatsInterval seconds of wall-clock time
+// and at the end of input: as a line on stderr if the path is "-", or else
+// as a Prometheus text file, replaced atomically so that a collector never
+// reads half of it
+class StatsWriter {
+  public:
+    StatsWriter(const std::string& path);
+    void update(const DemodStats& demod, const SyncStats& sync,
+        const GroupStats& groups, bool is_final=false);
+
+  private:
+    void writeLine(const DemodStats& demod, const SyncStats& sync,
+        const GroupStats& groups, double cycles_per_second) const;
+    void writeFile(const DemodStats& demod, const SyncStats& sync,
+        const GroupStats& groups, double cycles_per_second) const;
+
+    const std::string path_;
+    const std::chrono::steady_clock::time_point start_time_;
+    const uint64_t start_cycles_;
+    std::chrono::steady_clock::time_point next_write_;
+};
+
+} // namespace redsea
+#endif // STATS_H_
@@ -1,6 +1,12 @@
 #include "subcarrier.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <deque>
 #include <iostream>
 
@@ -10,10 +16,240 @@ namespace redsea {
 
 namespace {
 
-const float kFs = 228000.0f;
 const float kFc_0 = 57000.0f;
+const float kFc_pilot = 19000.0f;
+
+// Carriers of the RDS2 data streams 1-3, after the main stream 0
+const std::vector<float> kStreamCarriers = {kFc_0, 66500.0f, 71250.0f,
+                                            76000.0f};
 const int kInputBufferSize = 4096;
 const int kSamplesPerSymbol = 4;
+const int kDecimation = 96 / kSamplesPerSymbol;
+const int kLowpassLength = 256;
+const float kLowpassCutoff = 2100.0f;
+const float kPilotPLLBandwidth = 1e-7f;
+// Samples over which the phases of the pilot and the NCO are compared when
+// switching between them
+const int kPhaseMatchLength = 32;
+
+// Loops are wide until BlockStream finds sync, then narrowed for tracking.
+// They are widened again if the block error rate climbs past
+// kMaxTrackingErrorRate and narrowed once it is back under
+// kMinTrackingErrorRate.
+const LoopProfile kAcquisitionProfile = {0.005f, 0.002f, 0.04f};
+const LoopProfile kTrackingProfile    = {0.001f, 0.0004f, 0.02f};
+const float kMaxTrackingErrorRate = 0.3f;
+const float kMinTrackingErrorRate = 0.1f;
+
+// Taps of the equalizer, spaced one symbol (421 us) apart, its LMS step
+// size and leakage
+const int kEqualizerLength = 5;
+const float kEqualizerStepSize = 0.02f;
+const float kEqualizerLeakage = 0.001f;
+
+// A bit is decided on the center of its second symbol, 1.5 symbols after
+// the bit started, once it's through the lowpass and the symbol
+// synchronizer's matched filter (5 symbols); the equalizer adds half its
+// length
+const int kInputSamplesPerSymbol = kDecimation * kSamplesPerSymbol;
+const int kBitLatency = kLowpassLength / 2 +
+                        (5 * 2 + 3) * kInputSamplesPerSymbol / 2;
+const int kEqualizerLatency = kEqualizerLength / 2 * kInputSamplesPerSymbol;
+
+// Baseband samples per carrier offset estimate (54 ms), and the largest
+// offset looked for
+const unsigned kAcquisitionLength = 512;
+const float kMaxCarrierOffset = 250.0f;
+
+// The estimate only resets the AGC when the gain is off by more than this
+// many octaves (6 dB of amplitude per octave); otherwise the AGC keeps its
+// state across the repeated estimates
+const float kMaxAGCGainError = 1.0f;
+
+// The RDS detector compares the band where biphase RDS has most of its
+// energy, 1-2 kHz each side of the carrier, to empty MPX: above the 57 kHz
+// carrier (below it there may be stereo sidebands up to 53 kHz), or above
+// the RDS2 carriers, which leave no room between them. Decisions are made
+// once per input buffer (18 ms) on averaged powers: the chain is started
+// when the ratio exceeds kRDSOnRatio and idled after it has stayed under
+// kRDSOffRatio for kRDSHangBuffers (1 s). The buffers read while idle are
+// kept as pre-roll for when RDS is found.
+const std::vector<float> kRDSToneOffsets = {-1600.0f, -800.0f,
+                                             800.0f, 1600.0f};
+const std::vector<float> kNoiseToneFreqs     = {60000.0f, 62000.0f};
+const std::vector<float> kRDS2NoiseToneFreqs = {81000.0f, 83000.0f};
+const float kRDSDetectorAveraging = 0.25f;
+const float kRDSOnRatio = 4.0f;
+const float kRDSOffRatio = 2.0f;
+const int kRDSHangBuffers = 56;
+const size_t kPrerollBuffers = 16;
+
+// RDS is only a few percent of the MPX; the fixed-point lowpass gives it
+// 18 dB of gain to use more of the 16 bits
+const int kFixedLowpassGainShift = 3;
+
+// Symbols are Q12 at the output of fixed::AGC
+const float kFixedUnity = 4096.0f;
+
+// Vectors of one SSE or NEON, AVX2, and AVX-512 register
+typedef float FloatX4  __attribute__((vector_size(4 * sizeof(float))));
+typedef float FloatX8  __attribute__((vector_size(8 * sizeof(float))));
+typedef float FloatX16 __attribute__((vector_size(16 * sizeof(float))));
+
+// Unaligned loads and stores, since std::vector doesn't guarantee the
+// alignment of a whole vector
+template<typename V>
+inline void loadLanes(const float* p, V* v) {
+  std::memcpy(v, p, sizeof(*v));
+}
+
+template<typename V>
+inline void storeLanes(const V& v, float* p) {
+  std::memcpy(p, &v, sizeof(v));
+}
+
+// SubcarrierBank's per-sample work, on all lanes, sizeof(V) / sizeof(float)
+// lanes at a time. The build doesn't assume more than the baseline
+// instruction set, so the kernels are compiled once more for AVX2 and
+// AVX-512 and picked at startup, like those in dsp.cc.
+
+// Mixes one input sample of each lane down and stores it twice into the
+// filter history
+typedef void (*MixLanesFunc)(const float* in, float* phasor_re,
+    float* phasor_im, const float* rotation_re, const float* rotation_im,
+    float* hist_re, float* hist_im, int n_lanes, int n_taps);
+
+// Filters the n_taps samples of each lane that end at x_re/x_im, newest
+// first
+typedef void (*FilterLanesFunc)(const float* x_re, const float* x_im,
+    const float* taps, int n_lanes, int n_taps, float* out_re, float* out_im);
+
+template<typename V>
+__attribute__((always_inline))
+inline void mixLanesGeneric(const float* in, float* phasor_re,
+    float* phasor_im, const float* rotation_re, const float* rotation_im,
+    float* hist_re, float* hist_im, int n_lanes, int n_taps) {
+  const int width = sizeof(V) / sizeof(float);
+  for (int l=0; l<n_lanes; l+=width) {
+    V x, p_re, p_im, rot_re, rot_im;
+    loadLanes(&in[l], &x);
+    loadLanes(&phasor_re[l], &p_re);
+    loadLanes(&phasor_im[l], &p_im);
+    loadLanes(&rotation_re[l], &rot_re);
+    loadLanes(&rotation_im[l], &rot_im);
+
+    V re =  x * p_re;
+    V im = -x * p_im;
+    storeLanes(re, &hist_re[l]);
+    storeLanes(re, &hist_re[l + n_taps * n_lanes]);
+    storeLanes(im, &hist_im[l]);
+    storeLanes(im, &hist_im[l + n_taps * n_lanes]);
+
+    V next_re = p_re * rot_re - p_im * rot_im;
+    V next_im = p_re * rot_im + p_im * rot_re;
+    storeLanes(next_re, &phasor_re[l]);
+    storeLanes(next_im, &phasor_im[l]);
+  }
+}
+
+template<typename V>
+__attribute__((always_inline))
+inline void filterLanesGeneric(const float* x_re, const float* x_im,
+    const float* taps, int n_lanes, int n_taps, float* out_re,
+    float* out_im) {
+  const int width = sizeof(V) / sizeof(float);
+  for (int l=0; l<n_lanes; l+=width) {
+    V acc_re = V();
+    V acc_im = V();
+    for (int t=0; t<n_taps; t++) {
+      V v_re, v_im;
+      loadLanes(x_re + l - t * n_lanes, &v_re);
+      loadLanes(x_im + l - t * n_lanes, &v_im);
+      acc_re += taps[t] * v_re;
+      acc_im += taps[t] * v_im;
+    }
+    storeLanes(acc_re, &out_re[l]);
+    storeLanes(acc_im, &out_im[l]);
+  }
+}
+
+void mixLanesBaseline(const float* in, float* phasor_re, float* phasor_im,
+    const float* rotation_re, const float* rotation_im, float* hist_re,
+    float* hist_im, int n_lanes, int n_taps) {
+  mixLanesGeneric<FloatX4>(in, phasor_re, phasor_im, rotation_re,
+      rotation_im, hist_re, hist_im, n_lanes, n_taps);
+}
+
+void filterLanesBaseline(const float* x_re, const float* x_im,
+    const float* taps, int n_lanes, int n_taps, float* out_re,
+    float* out_im) {
+  filterLanesGeneric<FloatX4>(x_re, x_im, taps, n_lanes, n_taps, out_re,
+      out_im);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_LANE_KERNELS
+
+__attribute__((target("avx2,fma")))
+void mixLanesAVX2(const float* in, float* phasor_re, float* phasor_im,
+    const float* rotation_re, const float* rotation_im, float* hist_re,
+    float* hist_im, int n_lanes, int n_taps) {
+  mixLanesGeneric<FloatX8>(in, phasor_re, phasor_im, rotation_re,
+      rotation_im, hist_re, hist_im, n_lanes, n_taps);
+}
+
+__attribute__((target("avx2,fma")))
+void filterLanesAVX2(const float* x_re, const float* x_im,
+    const float* taps, int n_lanes, int n_taps, float* out_re,
+    float* out_im) {
+  filterLanesGeneric<FloatX8>(x_re, x_im, taps, n_lanes, n_taps, out_re,
+      out_im);
+}
+
+__attribute__((target("avx512f")))
+void mixLanesAVX512(const float* in, float* phasor_re, float* phasor_im,
+    const float* rotation_re, const float* rotation_im, float* hist_re,
+    float* hist_im, int n_lanes, int n_taps) {
+  mixLanesGeneric<FloatX16>(in, phasor_re, phasor_im, rotation_re,
+      rotation_im, hist_re, hist_im, n_lanes, n_taps);
+}
+
+__attribute__((target("avx512f")))
+void filterLanesAVX512(const float* x_re, const float* x_im,
+    const float* taps, int n_lanes, int n_taps, float* out_re,
+    float* out_im) {
+  filterLanesGeneric<FloatX16>(x_re, x_im, taps, n_lanes, n_taps, out_re,
+      out_im);
+}
+
+#endif // HAVE_X86_LANE_KERNELS
+
+struct LaneKernels {
+  MixLanesFunc mixLanes;
+  FilterLanesFunc filterLanes;
+};
+
+LaneKernels selectLaneKernels() {
+#ifdef HAVE_X86_LANE_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return {mixLanesAVX512, filterLanesAVX512};
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return {mixLanesAVX2, filterLanesAVX2};
+#endif
+  return {mixLanesBaseline, filterLanesBaseline};
+}
+
+const LaneKernels g_lane_kernels = selectLaneKernels();
+
+// "n/a" for a power of zero, which can't be measured in dB
+std::string decibels(double power) {
+  if (power <= 0.0)
+    return "n/a";
+  char buff[16];
+  snprintf(buff, sizeof(buff), "%.1f dB", 10 * std::log10(power));
+  return std::string(buff);
+}
 
 }
 
@@ -32,16 +268,92 @@ unsigned DeltaDecoder::decode(unsigned d) {
   return bit;
 }
 
-Subcarrier::Subcarrier() : numsamples_(0), bit_buffer_(),
-  fir_lpf_(256, 2100.0f / kFs), is_eof_(false), agc_(0.001f),
-  nco_approx_(kFc_0 * 2 * M_PI / kFs), nco_exact_(0.0f),
-  symsync_(LIQUID_FIRFILT_RRC, kSamplesPerSymbol, 5, 0.5f, 32),
-  modem_(LIQUID_MODEM_PSK2), symbol_clock_(0), prev_biphase_(0),
-  delta_decoder_(), symbol_errors_(0) {
+struct Subcarrier::FloatChain {
+  FloatChain(float carrier_frequency) :
+    fir_lpf(kLowpassLength, kLowpassCutoff / kMPXRate),
+    agc(kAcquisitionProfile.agc),
+    nco_approx(carrier_frequency * 2 * M_PI / kMPXRate), nco_coarse(0.0f),
+    nco_exact(0.0f),
+    pilot_pll(kFc_pilot * 2 * M_PI / kMPXRate, kPilotPLLBandwidth),
+    symsync(LIQUID_FIRFILT_RRC, kSamplesPerSymbol, 5, 0.5f, 32),
+    equalizer(kEqualizerLength, kEqualizerStepSize, kEqualizerLeakage),
+    modem(LIQUID_MODEM_PSK2), fft(kAcquisitionLength) {
 
-    symsync_.setBandwidth(0.02f);
-    symsync_.setOutputRate(1);
-    nco_exact_.setPLLBandwidth(0.0004f);
+    symsync.setOutputRate(1);
+
+  }
+  kernels::FIRFilter fir_lpf;
+  kernels::AGC agc;
+  kernels::NCO nco_approx;
+  kernels::NCO nco_coarse;
+  kernels::NCO nco_exact;
+  dsp::PilotPLL pilot_pll;
+  kernels::SymSync symsync;
+  dsp::LMSEqualizer equalizer;
+  liquid::Modem modem;
+  liquid::FFT fft;
+};
+
+struct Subcarrier::FixedChain {
+  FixedChain(float carrier_frequency) :
+    lpf(kLowpassLength, kLowpassCutoff / kMPXRate, kFixedLowpassGainShift),
+    agc(kAcquisitionProfile.agc),
+    nco_approx(carrier_frequency * 2 * M_PI / kMPXRate), nco_exact(0.0f),
+    symsync(kSamplesPerSymbol, 5, 0.5f, 32) {
+
+  }
+  fixed::FIRFilter lpf;
+  fixed::AGC agc;
+  fixed::NCO nco_approx;
+  fixed::NCO nco_exact;
+  fixed::SymSync symsync;
+};
+
+Subcarrier::Subcarrier(const Options& options, int stream) :
+  stream_(stream),
+  label_(stream > 0 ? "stream " + std::to_string(stream) : ""),
+  carrier_frequency_(kStreamCarriers.at(stream)),
+  numsamples_(0), sample_index_(0),
+  bit_latency_(kBitLatency + (options.use_equalizer &&
+      !options.use_fixed_point ? kEqualizerLatency : 0)),
+  bit_buffer_(),
+  float_(options.use_fixed_point ? nullptr :
+      new FloatChain(carrier_frequency_)),
+  is_eof_(false), use_pilot_(options.use_pilot && stream == 0),
+  is_pilot_locked_(false), carrier_rotation_(1.0f),
+  use_equalizer_(options.use_equalizer), prev_equalized_(0.0f),
+  symbol_amplitude_(0.0f),
+  equalizer_stats_(), acquisition_buffer_(),
+  is_acquiring_(true), is_tracking_(false), symbol_clock_(0), prev_biphase_(0),
+  prev_reliability_(0.0f), delta_decoder_(), symbol_errors_(0),
+  use_rds_gate_(options.use_rds_gate),
+  rds_tones_(), noise_tones_(), rds_energy_(0.0f), noise_energy_(0.0f),
+  is_rds_present_(false), buffers_since_rds_(0), preroll_(), samples_read_(0),
+  rds_start_(0), rds_end_(0), rds_range_handler_(), diagnostic_handler_(),
+  has_gap_(false), use_fixed_point_(options.use_fixed_point),
+  fixed_(options.use_fixed_point ? new FixedChain(carrier_frequency_) :
+      nullptr),
+  fixed_phase_error_(0), reference_(), unpaired_fixed_(), unpaired_float_(),
+  comparison_(), use_cycle_counter_(!options.stats_path.empty()),
+  stats_() {
+
+    setLoopProfile(kAcquisitionProfile);
+
+    for (float f : kRDSToneOffsets)
+      rds_tones_.push_back(dsp::Goertzel((carrier_frequency_ + f) *
+            2 * M_PI / kMPXRate));
+    for (float f : (stream == 0 ? kNoiseToneFreqs : kRDS2NoiseToneFreqs))
+      noise_tones_.push_back(dsp::Goertzel(f * 2 * M_PI / kMPXRate));
+
+    // Without the equalizer, which the fixed-point chain doesn't have
+    if (use_fixed_point_ && options.compare_fixed_point) {
+      Options reference_options = options;
+      reference_options.use_fixed_point = false;
+      reference_options.compare_fixed_point = false;
+      reference_options.use_equalizer = false;
+      reference_options.stats_path.clear();
+      reference_.reset(new Subcarrier(reference_options, stream));
+    }
 
 }
 
@@ -51,66 +363,667 @@ Subcarrier::~Subcarrier() {
 
 void Subcarrier::demodulateMoreBits() {
 
-  int16_t sample[kInputBufferSize];
-  int samplesread = fread(sample, sizeof(sample[0]), kInputBufferSize, stdin);
+  std::vector<int16_t> sample(kInputBufferSize);
+  int samplesread = fread(sample.data(), sizeof(sample[0]), kInputBufferSize,
+      stdin);
   if (samplesread < kInputBufferSize) {
     is_eof_ = true;
+    endInput();
     return;
   }
 
-  for (int i = 0; i < samplesread; i++) {
+  for (SoftBit bit : demodulate(sample))
+    bit_buffer_.push_back(bit);
 
-    std::complex<float> sample_baseband = nco_approx_.mixDown(sample[i]);
+}
 
-    fir_lpf_.push(sample_baseband);
+std::vector<SoftBit> Subcarrier::demodulate(
+    const std::vector<int16_t>& samples) {
 
-    if (numsamples_ % (96 / kSamplesPerSymbol) == 0) {
+  uint64_t start_cycles = (use_cycle_counter_ ? readCycleCounter() : 0);
+  stats_.num_samples += samples.size();
 
-      std::complex<float> sample_lopass = agc_.execute(fir_lpf_.execute());
+  std::vector<SoftBit> bits;
 
-      nco_exact_.stepPLL(modem_.getPhaseError());
-      sample_lopass = nco_exact_.mixDown(sample_lopass);
+  if (!use_rds_gate_) {
+    bits = demodulateChain(samples);
 
-      std::vector<std::complex<float>> symbols =
-        symsync_.execute(sample_lopass);
+  // The detector's time constants are in buffers of kInputBufferSize,
+  // whatever the size of the caller's chunks
+  } else {
+    for (size_t i=0; i<samples.size(); i += kInputBufferSize) {
+      size_t end = std::min(samples.size(), i + kInputBufferSize);
+      std::vector<int16_t> buffer(samples.begin() + i, samples.begin() + end);
+      for (SoftBit bit : demodulateGated(buffer))
+        bits.push_back(bit);
+    }
+  }
 
-      for (std::complex<float> symbol : symbols) {
-        unsigned biphase = modem_.demodulate(symbol);
+  if (use_cycle_counter_)
+    stats_.cycles += readCycleCounter() - start_cycles;
 
-        if (symbol_clock_ == 1) {
-          bit_buffer_.push_back(delta_decoder_.decode(biphase));
+  return bits;
 
-          if (biphase ^ prev_biphase_) {
-            symbol_errors_ = 0;
-          } else {
-            symbol_errors_ ++;
-            if (symbol_errors_ >= 7) {
-              symbol_clock_ ^= 1;
-              symbol_errors_ = 0;
-            }
-          }
-        }
+}
 
-        prev_biphase_ = biphase;
+std::vector<SoftBit> Subcarrier::demodulateGated(
+    const std::vector<int16_t>& samples) {
 
-        symbol_clock_ ^= 1;
+  const bool was_rds_present = is_rds_present_;
+  is_rds_present_ = detectRDS(samples);
+  samples_read_ += samples.size();
+
+  std::vector<SoftBit> bits;
 
+  if (is_rds_present_) {
+    if (buffers_since_rds_ == 0)
+      rds_end_ = samples_read_;
+
+    // Restart from the pre-roll, as after a sync loss
+    if (!was_rds_present) {
+      rds_start_ = samples_read_ - samples.size();
+      for (const std::vector<int16_t>& buffer : preroll_)
+        rds_start_ -= buffer.size();
+      reacquire();
+      has_gap_ = true;
+
+      // The chain skipped the samples read while idle
+      sample_index_ = rds_start_ +
+        (kDecimation - numsamples_ % kDecimation) % kDecimation;
+
+      for (const std::vector<int16_t>& buffer : preroll_) {
+        for (SoftBit bit : demodulateChain(buffer))
+          bits.push_back(bit);
       }
+      preroll_.clear();
     }
 
-    nco_approx_.step();
+    for (SoftBit bit : demodulateChain(samples))
+      bits.push_back(bit);
+
+  } else {
+    preroll_.push_back(samples);
+    if (preroll_.size() > kPrerollBuffers)
+      preroll_.pop_front();
+
+    if (was_rds_present)
+      printRDSRange();
+  }
+
+  return bits;
+
+}
+
+// Returns whether RDS is present, with hysteresis
+bool Subcarrier::detectRDS(const std::vector<int16_t>& samples) {
+
+  float rds_energy = 0.0f;
+  for (const dsp::Goertzel& tone : rds_tones_)
+    rds_energy += tone.execute(samples);
+  rds_energy /= rds_tones_.size();
+
+  float noise_energy = 0.0f;
+  for (const dsp::Goertzel& tone : noise_tones_)
+    noise_energy += tone.execute(samples);
+  noise_energy /= noise_tones_.size();
+
+  rds_energy_   += kRDSDetectorAveraging * (rds_energy - rds_energy_);
+  noise_energy_ += kRDSDetectorAveraging * (noise_energy - noise_energy_);
+
+  if (!is_rds_present_) {
+    buffers_since_rds_ = 0;
+    return rds_energy_ > kRDSOnRatio * noise_energy_;
+  }
+
+  if (rds_energy_ > kRDSOffRatio * noise_energy_)
+    buffers_since_rds_ = 0;
+  else
+    buffers_since_rds_ ++;
+
+  return buffers_since_rds_ < kRDSHangBuffers;
+
+}
+
+// Seconds from the start of input, to the handler or else on stderr
+void Subcarrier::printRDSRange() const {
+  if (rds_range_handler_)
+    rds_range_handler_(rds_start_ / kMPXRate, rds_end_ / kMPXRate);
+  else
+    fprintf(stderr, "rds %.3f %.3f%s%s\n", rds_start_ / kMPXRate,
+        rds_end_ / kMPXRate, label_.empty() ? "" : " ", label_.c_str());
+}
+
+// To the handler or else on stderr
+void Subcarrier::printDiagnostic(const std::string& line) const {
+  if (diagnostic_handler_)
+    diagnostic_handler_(line);
+  else
+    fprintf(stderr, "%s\n", line.c_str());
+}
+
+void Subcarrier::setLabel(const std::string& label) {
+  label_ = label;
+}
+
+void Subcarrier::setRDSRangeHandler(
+    const std::function<void(double start, double end)>& handler) {
+  rds_range_handler_ = handler;
+}
+
+void Subcarrier::setDiagnosticHandler(
+    const std::function<void(const std::string& line)>& handler) {
+  diagnostic_handler_ = handler;
+}
+
+bool Subcarrier::popGap() {
+  bool result = has_gap_;
+  has_gap_ = false;
+  return result;
+}
+
+void Subcarrier::endInput() {
+  if (is_rds_present_)
+    printRDSRange();
+  if (use_equalizer_ && !use_fixed_point_)
+    printEqualizerStats();
+  if (reference_)
+    printComparison();
+}
+
+std::vector<SoftBit> Subcarrier::demodulateChain(
+    const std::vector<int16_t>& samples) {
+
+  if (use_fixed_point_) {
+    std::vector<SoftBit> fixed_bits = demodulateFixed(samples);
+    if (reference_)
+      compareBits(fixed_bits, reference_->demodulateChain(samples));
+    return fixed_bits;
+  }
+
+  std::vector<SoftBit> bits;
+
+  std::vector<std::complex<float>> baseband(samples.begin(), samples.end());
+
+  // The pilot is tracked even when absent, to notice when it appears. On
+  // mono stations the carrier loop is left to pull in on its own. The NCO
+  // keeps running under the pilot, and when switching between the two the
+  // new one is rotated to continue the phase of the old one.
+  if (use_pilot_) {
+    std::vector<std::complex<float>> pilot_baseband(baseband.size());
+    float_->pilot_pll.mixBlockDown(baseband.data(), pilot_baseband.data(),
+        baseband.size());
+    float_->nco_approx.mixBlockDown(baseband.data(), baseband.data(),
+        baseband.size());
+
+    if (float_->pilot_pll.isLocked() != is_pilot_locked_) {
+      is_pilot_locked_ = !is_pilot_locked_;
+      const std::vector<std::complex<float>>& from =
+        (is_pilot_locked_ ? baseband : pilot_baseband);
+      const std::vector<std::complex<float>>& to =
+        (is_pilot_locked_ ? pilot_baseband : baseband);
+      std::complex<float> difference = 0.0f;
+      for (size_t i=0; i<std::min<size_t>(from.size(), kPhaseMatchLength); i++)
+        difference += from[i] * std::conj(to[i]);
+      if (std::abs(difference) > 0.0f)
+        carrier_rotation_ *= difference / std::abs(difference);
+    }
+
+    if (is_pilot_locked_)
+      baseband.swap(pilot_baseband);
+    for (std::complex<float>& sample : baseband)
+      sample *= carrier_rotation_;
+  } else {
+    float_->nco_approx.mixBlockDown(baseband.data(), baseband.data(),
+        baseband.size());
+  }
+
+  for (std::complex<float> sample_baseband : baseband) {
+
+    float_->fir_lpf.push(sample_baseband);
+
+    if (numsamples_ % kDecimation == 0)
+      demodulateBaseband(float_->fir_lpf.execute(), &bits);
 
     numsamples_ ++;
 
   }
 
+  return bits;
+
+}
+
+void Subcarrier::demodulateBaseband(std::complex<float> sample_lopass,
+    std::vector<SoftBit>* bits) {
+
+  if (is_acquiring_)
+    acquireCarrier(sample_lopass);
+
+  sample_lopass = float_->agc.execute(sample_lopass);
+
+  sample_lopass = float_->nco_coarse.mixDown(sample_lopass);
+  float_->nco_coarse.step();
+
+  float_->nco_exact.stepPLL(float_->modem.getPhaseError());
+  sample_lopass = float_->nco_exact.mixDown(sample_lopass);
+
+  std::vector<std::complex<float>> symbols =
+    float_->symsync.execute(sample_lopass);
+
+  for (std::complex<float> symbol : symbols) {
+    unsigned biphase = float_->modem.demodulate(symbol);
+    float reliability = std::fabs(symbol.real());
+
+    // The carrier loop keeps running on the unequalized symbols, so that
+    // the equalizer is left with the intersymbol interference
+    if (use_equalizer_) {
+      std::complex<float> equalized = equalize(symbol);
+      biphase = (equalized.real() < 0.0f);
+      reliability = std::fabs(equalized.real());
+    }
+
+    decodeBiphase(biphase, reliability, bits);
+  }
+
+  sample_index_ += kDecimation;
+
 }
 
-int Subcarrier::getNextBit() {
+// Decision-directed, on the biphase decision: the two symbols of a bit have
+// opposite signs, so the sign of their difference decides the second one
+// with twice the distance of its own sign. Training on the first symbol as
+// well, against its nearest BPSK point, lets the noisier decisions pull the
+// taps away. Statistics are only kept once the carrier has been acquired.
+std::complex<float> Subcarrier::equalize(std::complex<float> symbol) {
+
+  std::complex<float> result = float_->equalizer.execute(symbol);
+  std::complex<float> decision(result.real() < 0.0f ? -1.0f : 1.0f, 0.0f);
+  if (symbol_clock_ == 1) {
+    std::complex<float> biphase_decision(
+        result.real() < prev_equalized_ ? -1.0f : 1.0f, 0.0f);
+    float_->equalizer.train(biphase_decision - result);
+  }
+  prev_equalized_ = result.real();
+
+  std::complex<float> center = float_->equalizer.getCenterSample();
+  symbol_amplitude_ += 0.01f * (std::fabs(center.real()) - symbol_amplitude_);
+
+  if (!is_acquiring_ && symbol_amplitude_ > 0.0f) {
+    std::complex<float> center_decision(center.real() < 0.0f ? -1.0f : 1.0f,
+                                        0.0f);
+    equalizer_stats_.num_symbols ++;
+    if (center_decision != decision)
+      equalizer_stats_.num_changed ++;
+    equalizer_stats_.error_in +=
+      std::norm(center / symbol_amplitude_ - center_decision);
+    equalizer_stats_.error_out += std::norm(decision - result);
+  }
+
+  return result;
+
+}
+
+// At the end of input
+void Subcarrier::printEqualizerStats() const {
+  const EqualizerStats& stats = equalizer_stats_;
+  if (stats.num_symbols == 0)
+    return;
+  char line[256];
+  snprintf(line, sizeof(line), "equalizer%s%s: %llu symbols, "
+      "%llu multiply-adds, %llu decisions changed, error %s before, "
+      "%s after",
+      label_.empty() ? "" : " ", label_.c_str(),
+      (unsigned long long)stats.num_symbols,
+      (unsigned long long)(stats.num_symbols * 2 * kEqualizerLength),
+      (unsigned long long)stats.num_changed,
+      decibels(stats.error_in / stats.num_symbols).c_str(),
+      decibels(stats.error_out / stats.num_symbols).c_str());
+  printDiagnostic(line);
+}
+
+void Subcarrier::skipSamples(uint64_t num_samples) {
+  if (is_rds_present_) {
+    printRDSRange();
+    is_rds_present_ = false;
+  }
+  sample_index_ += num_samples;
+  samples_read_ += num_samples;
+  reacquire();
+  has_gap_ = true;
+}
+
+// Same detector as in demodulate(), but without the pre-roll: the bank has
+// already moved on
+bool Subcarrier::gate(const std::vector<int16_t>& samples) {
+  if (!use_rds_gate_)
+    return true;
+
+  bool has_rds = false;
+  for (size_t i=0; i<samples.size(); i += kInputBufferSize) {
+    size_t end = std::min(samples.size(), i + kInputBufferSize);
+    std::vector<int16_t> buffer(samples.begin() + i, samples.begin() + end);
+
+    const bool was_rds_present = is_rds_present_;
+    is_rds_present_ = detectRDS(buffer);
+    samples_read_ += buffer.size();
+
+    if (is_rds_present_) {
+      if (buffers_since_rds_ == 0)
+        rds_end_ = samples_read_;
+      if (!was_rds_present)
+        rds_start_ = samples_read_ - buffer.size();
+      has_rds = true;
+    } else if (was_rds_present) {
+      printRDSRange();
+    }
+  }
+
+  if (!has_rds) {
+    sample_index_ += samples.size();
+    reacquire();
+    has_gap_ = true;
+  }
+
+  return has_rds;
+}
+
+// Same chain as demodulate() and demodulateBaseband(), on integers. The
+// symbol decision and phase error are those of liquid's PSK2 modem.
+std::vector<SoftBit> Subcarrier::demodulateFixed(
+    const std::vector<int16_t>& samples) {
+
+  std::vector<SoftBit> bits;
+
+  std::vector<fixed::Complex> baseband;
+  fixed_->nco_approx.mixBlockDown(samples, &baseband);
+
+  for (fixed::Complex sample_baseband : baseband) {
+
+    fixed_->lpf.push(sample_baseband);
+
+    if (numsamples_ % kDecimation == 0) {
+      fixed::Complex sample_lopass =
+        fixed_->agc.execute(fixed_->lpf.execute());
+
+      fixed_->nco_exact.stepPLL(fixed_phase_error_);
+      sample_lopass = fixed_->nco_exact.mixDown(sample_lopass);
+
+      for (fixed::Complex symbol : fixed_->symsync.execute(sample_lopass)) {
+        unsigned biphase = (symbol.re < 0);
+        fixed_phase_error_ = (biphase ? -symbol.im : symbol.im);
+        decodeBiphase(biphase, std::abs(symbol.re) / kFixedUnity, &bits);
+      }
+
+      sample_index_ += kDecimation;
+    }
+
+    numsamples_ ++;
+
+  }
+
+  return bits;
+
+}
+
+// Bits of the two chains are paired when they start less than half a bit
+// apart; the chains' latencies are the same
+void Subcarrier::compareBits(const std::vector<SoftBit>& fixed_bits,
+    const std::vector<SoftBit>& float_bits) {
+
+  unpaired_fixed_.insert(unpaired_fixed_.end(), fixed_bits.begin(),
+      fixed_bits.end());
+  unpaired_float_.insert(unpaired_float_.end(), float_bits.begin(),
+      float_bits.end());
+
+  while (!unpaired_fixed_.empty() && !unpaired_float_.empty()) {
+    const SoftBit& a = unpaired_fixed_.front();
+    const SoftBit& b = unpaired_float_.front();
+    if (a.sample + kInputSamplesPerSymbol <= b.sample) {
+      unpaired_fixed_.pop_front();
+      comparison_.num_unpaired ++;
+    } else if (b.sample + kInputSamplesPerSymbol <= a.sample) {
+      unpaired_float_.pop_front();
+      comparison_.num_unpaired ++;
+    } else {
+      comparison_.num_bits ++;
+      if (a.value != b.value)
+        comparison_.num_differing ++;
+      unpaired_fixed_.pop_front();
+      unpaired_float_.pop_front();
+    }
+  }
+
+}
+
+// At the end of input
+void Subcarrier::printComparison() const {
+  const FixedPointComparison& c = comparison_;
+  char line[256];
+  snprintf(line, sizeof(line), "fixed point%s%s: %llu bits paired with the "
+      "float chain, %llu differ (%.3f %%), %llu unpaired",
+      label_.empty() ? "" : " ", label_.c_str(),
+      (unsigned long long)c.num_bits, (unsigned long long)c.num_differing,
+      c.num_bits > 0 ? 100.0 * c.num_differing / c.num_bits : 0.0,
+      (unsigned long long)c.num_unpaired);
+  printDiagnostic(line);
+}
+
+// Seeds the AGC and the carrier offset from a short stretch of baseband,
+// repeatedly until BlockStream finds sync. BPSK has no carrier to look for,
+// but squaring it removes the modulation and leaves a tone at twice the
+// carrier offset.
+void Subcarrier::acquireCarrier(std::complex<float> sample) {
+
+  acquisition_buffer_.push_back(sample * sample);
+  if (acquisition_buffer_.size() < kAcquisitionLength)
+    return;
+
+  float power = 0.0f;
+  for (std::complex<float> s : acquisition_buffer_)
+    power += std::abs(s);
+  power /= kAcquisitionLength;
+  if (power > 0.0f) {
+    float gain = 1.0f / std::sqrt(power);
+    if (std::fabs(std::log2(gain / float_->agc.getGain())) > kMaxAGCGainError)
+      float_->agc.setGain(gain);
+  }
+
+  std::vector<std::complex<float>> spectrum =
+    float_->fft.execute(acquisition_buffer_);
+  acquisition_buffer_.clear();
+
+  const int n = kAcquisitionLength;
+  const int max_bin = 2 * kMaxCarrierOffset / (kMPXRate / kDecimation) * n;
+
+  int peak_bin = 0;
+  float peak_magnitude = 0.0f;
+  for (int k=-max_bin; k<=max_bin; k++) {
+    if (std::abs(spectrum[(k + n) % n]) > peak_magnitude) {
+      peak_bin = k;
+      peak_magnitude = std::abs(spectrum[(k + n) % n]);
+    }
+  }
+
+  // Parabolic interpolation between bins
+  float a = std::abs(spectrum[(peak_bin - 1 + n) % n]);
+  float b = peak_magnitude;
+  float c = std::abs(spectrum[(peak_bin + 1 + n) % n]);
+  float denom = a - 2 * b + c;
+  float fraction = (denom != 0.0f ? 0.5f * (a - c) / denom : 0.0f);
+
+  float_->nco_coarse.setFrequency(M_PI * (peak_bin + fraction) / n);
+
+}
+
+void Subcarrier::setLoopProfile(const LoopProfile& profile) {
+  if (float_) {
+    float_->agc.setBandwidth(profile.agc);
+    float_->nco_exact.setPLLBandwidth(profile.pll);
+    float_->symsync.setBandwidth(profile.symsync);
+  }
+
+  if (fixed_) {
+    fixed_->agc.setBandwidth(profile.agc);
+    fixed_->nco_exact.setPLLBandwidth(profile.pll);
+    fixed_->symsync.setBandwidth(profile.symsync);
+  }
+}
+
+// Back to the coarse carrier search and the wide loops, as at startup
+void Subcarrier::reacquire() {
+  setLoopProfile(kAcquisitionProfile);
+  is_tracking_ = false;
+  acquisition_buffer_.clear();
+  is_acquiring_ = true;
+}
+
+void Subcarrier::updateSync(bool is_in_sync, float block_error_rate) {
+  if (reference_)
+    reference_->updateSync(is_in_sync, block_error_rate);
+
+  if (!is_in_sync) {
+    reacquire();
+    return;
+  }
+
+  is_acquiring_ = false;
+
+  if (is_tracking_ && block_error_rate > kMaxTrackingErrorRate) {
+    setLoopProfile(kAcquisitionProfile);
+    is_tracking_ = false;
+  } else if (!is_tracking_ && block_error_rate < kMinTrackingErrorRate) {
+    setLoopProfile(kTrackingProfile);
+    is_tracking_ = true;
+  }
+}
+
+// A bit is the difference of two consecutive symbols, so it is only as
+// reliable as the weaker of them
+void Subcarrier::decodeBiphase(unsigned biphase, float reliability,
+    std::vector<SoftBit>* bits) {
+
+  stats_.num_symbols ++;
+
+  if (symbol_clock_ == 1) {
+    bits->push_back({int(delta_decoder_.decode(biphase)),
+                     std::min(reliability, prev_reliability_),
+                     sample_index_ > bit_latency_ ?
+                       sample_index_ - bit_latency_ : 0});
+    prev_reliability_ = reliability;
+
+    if (biphase ^ prev_biphase_) {
+      symbol_errors_ = 0;
+    } else {
+      symbol_errors_ ++;
+      if (symbol_errors_ >= 7) {
+        symbol_clock_ ^= 1;
+        symbol_errors_ = 0;
+      }
+    }
+  }
+
+  prev_biphase_ = biphase;
+
+  symbol_clock_ ^= 1;
+
+}
+
+SubcarrierBank::SubcarrierBank(int num_streams) : num_streams_(num_streams),
+  num_blocks_((num_streams + kLaneWidth - 1) / kLaneWidth), numsamples_(0),
+  taps_(), history_pos_(0),
+  history_re_(2 * kLowpassLength * num_blocks_ * kLaneWidth),
+  history_im_(2 * kLowpassLength * num_blocks_ * kLaneWidth),
+  phasor_re_(num_blocks_ * kLaneWidth, 1.0f),
+  phasor_im_(num_blocks_ * kLaneWidth, 0.0f),
+  rotation_re_(num_blocks_ * kLaneWidth, std::cos(kFc_0 * 2 * M_PI / kMPXRate)),
+  rotation_im_(num_blocks_ * kLaneWidth, std::sin(kFc_0 * 2 * M_PI / kMPXRate)),
+  pending_(num_streams) {
+
+  // Same filter as the float chain's lowpass in Subcarrier
+  liquid::designKaiserFilter(kLowpassLength, kLowpassCutoff / kMPXRate, &taps_);
+
+}
+
+std::vector<std::vector<std::complex<float>>> SubcarrierBank::demodulate(
+    const std::vector<std::vector<int16_t>>& samples) {
+
+  assert ((int)samples.size() == num_streams_);
+
+  // Lanes advance in lockstep; samples that some lanes are ahead by wait for
+  // the next call. Streams with no input at all are idle and don't hold
+  // back the others.
+  size_t num_lockstep = SIZE_MAX;
+  for (int s=0; s<num_streams_; s++) {
+    pending_[s].insert(pending_[s].end(), samples[s].begin(),
+        samples[s].end());
+    if (!samples[s].empty())
+      num_lockstep = std::min(num_lockstep, pending_[s].size());
+  }
+  if (num_lockstep == SIZE_MAX)
+    num_lockstep = 0;
+
+  std::vector<std::vector<std::complex<float>>> result(num_streams_);
+
+  const int n_lanes = num_blocks_ * kLaneWidth;
+  const int n_taps  = taps_.size();
+  std::vector<float> in(n_lanes);
+  std::vector<float> out_re(n_lanes);
+  std::vector<float> out_im(n_lanes);
+
+  for (size_t n=0; n<num_lockstep; n++) {
+
+    for (int s=0; s<num_streams_; s++)
+      in[s] = (samples[s].empty() ? 0.0f : pending_[s][n]);
+
+    // Mix down and push into the filter history, which is stored twice so
+    // that the newest n_taps samples are always contiguous
+    g_lane_kernels.mixLanes(in.data(), phasor_re_.data(), phasor_im_.data(),
+        rotation_re_.data(), rotation_im_.data(),
+        &history_re_[history_pos_ * n_lanes],
+        &history_im_[history_pos_ * n_lanes], n_lanes, n_taps);
+
+    if (numsamples_ % kDecimation == 0) {
+      // history_pos_ + n_taps is the newest sample, history_pos_ + 1 the
+      // oldest
+      g_lane_kernels.filterLanes(
+          &history_re_[(history_pos_ + n_taps) * n_lanes],
+          &history_im_[(history_pos_ + n_taps) * n_lanes], taps_.data(),
+          n_lanes, n_taps, out_re.data(), out_im.data());
+
+      for (int s=0; s<num_streams_; s++)
+        if (!samples[s].empty())
+          result[s].push_back(std::complex<float>(out_re[s], out_im[s]));
+    }
+
+    // Keep the phasors on the unit circle
+    if (numsamples_ % kInputBufferSize == 0) {
+      for (int l=0; l<n_lanes; l++) {
+        float mag = std::sqrt(phasor_re_[l] * phasor_re_[l] +
+                              phasor_im_[l] * phasor_im_[l]);
+        phasor_re_[l] /= mag;
+        phasor_im_[l] /= mag;
+      }
+    }
+
+    history_pos_ = (history_pos_ + 1) % n_taps;
+    numsamples_ ++;
+  }
+
+  for (int s=0; s<num_streams_; s++) {
+    if (!samples[s].empty())
+      pending_[s].erase(pending_[s].begin(), pending_[s].begin() + num_lockstep);
+    else
+      pending_[s].clear();
+  }
+
+  return result;
+
+}
+
+SoftBit Subcarrier::getNextBit() {
   while (bit_buffer_.size() < 1 && !isEOF())
     demodulateMoreBits();
 
-  int bit = 0;
+  SoftBit bit = {0, 0.0f, 0};
 
   if (bit_buffer_.size() > 0) {
     bit = bit_buffer_.front();
@@ -120,6 +1033,10 @@ int Subcarrier::getNextBit() {
   return bit;
 }
 
+const DemodStats& Subcarrier::getStats() const {
+  return stats_;
+}
+
 bool Subcarrier::isEOF() const {
   return is_eof_;
 }
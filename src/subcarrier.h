@@ -3,12 +3,31 @@
 
 #include <deque>
 #include <complex>
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "common.h"
+#include "dsp.h"
+#include "fixed_point.h"
 #include "liquid_wrappers.h"
+#include "stats.h"
 
 namespace redsea {
 
+// DSP objects used by Subcarrier: redsea's own by default, or liquid-dsp's
+// as a reference for differential testing (configure --enable-liquid-kernels)
+#ifdef USE_LIQUID_KERNELS
+namespace kernels = ::liquid;
+#else
+namespace kernels = ::redsea::dsp;
+#endif
+
+// SubcarrierBank pads the number of streams to a multiple of this, the
+// width of the widest vector it uses (AVX-512, in floats)
+const int kLaneWidth = 16;
+
 class DeltaDecoder {
   public:
     DeltaDecoder();
@@ -18,37 +37,208 @@ class DeltaDecoder {
     unsigned prev_;
 };
 
+// A demodulated bit, how far its symbols were from the decision threshold
+// (about 1 for a clean signal, 0 for a guess), and the input sample where it
+// started
+struct SoftBit {
+  int value;
+  float reliability;
+  uint64_t sample;
+};
+
+// What the equalizer (-e) costs and what it changes
+struct EqualizerStats {
+  EqualizerStats() : num_symbols(0), num_changed(0), error_in(0.0),
+    error_out(0.0) {}
+  uint64_t num_symbols;
+  // Decisions that differ from those on the unequalized symbols
+  uint64_t num_changed;
+  // Sums of squared distances to the decision, with the input normalized
+  // to the same amplitude as the output
+  double error_in;
+  double error_out;
+};
+
+// How far the fixed-point bits (-F) are from those of the float chain (-C).
+// Bits are paired by their input sample.
+struct FixedPointComparison {
+  FixedPointComparison() : num_bits(0), num_differing(0), num_unpaired(0) {}
+  uint64_t num_bits;
+  uint64_t num_differing;
+  // Found by only one of the chains, e.g. after a clock slip
+  uint64_t num_unpaired;
+};
+
+// Bandwidths of the demodulator's loops
+struct LoopProfile {
+  float agc;
+  float pll;
+  float symsync;
+};
+
 class Subcarrier {
   public:
-    Subcarrier();
+    // stream is 0 for the 57 kHz subcarrier, 1-3 for the RDS2 streams
+    Subcarrier(const Options& options=Options(), int stream=0);
     ~Subcarrier();
-    int getNextBit();
+    SoftBit getNextBit();
     bool isEOF() const;
+    std::vector<SoftBit> demodulate(const std::vector<int16_t>& samples);
+    void demodulateBaseband(std::complex<float> sample,
+        std::vector<SoftBit>* bits);
+    // Input samples that the caller didn't pass to demodulateBaseband(); the
+    // chain reacquires after them and the next popGap() is true
+    void skipSamples(uint64_t num_samples);
+    // The RDS detector (-g) for input that is mixed down elsewhere, by a
+    // SubcarrierBank. Returns whether to demodulate the samples; if not,
+    // they are skipped as by skipSamples().
+    bool gate(const std::vector<int16_t>& samples);
+    // Called by BlockStream after every block while in sync, and when sync
+    // is lost
+    void updateSync(bool is_in_sync, float block_error_rate);
+    // True once after the chain was idled by the RDS detector (-g): the bits
+    // that follow don't continue the ones before
+    bool popGap();
+    // Prints the diagnostics kept until the end of input (-g, -e)
+    void endInput();
+    // Appended to the diagnostics, to tell several decoders apart
+    void setLabel(const std::string& label);
+    // Called with the start and end of each stretch of input in which the
+    // RDS detector (-g) found RDS, in seconds, instead of printing them
+    void setRDSRangeHandler(
+        const std::function<void(double start, double end)>& handler);
+    // Called with each line of the equalizer (-e) and fixed-point (-C)
+    // summaries, instead of printing them
+    void setDiagnosticHandler(
+        const std::function<void(const std::string& line)>& handler);
+    const DemodStats& getStats() const;
   private:
     void demodulateMoreBits();
+    std::vector<SoftBit> demodulateGated(
+        const std::vector<int16_t>& samples);
+    std::vector<SoftBit> demodulateChain(
+        const std::vector<int16_t>& samples);
+    bool detectRDS(const std::vector<int16_t>& samples);
+    void printRDSRange() const;
+    void printDiagnostic(const std::string& line) const;
+    void setLoopProfile(const LoopProfile& profile);
+    void reacquire();
+    void acquireCarrier(std::complex<float> sample);
+    std::complex<float> equalize(std::complex<float> symbol);
+    void printEqualizerStats() const;
+    std::vector<SoftBit> demodulateFixed(
+        const std::vector<int16_t>& samples);
+    void compareBits(const std::vector<SoftBit>& fixed_bits,
+        const std::vector<SoftBit>& float_bits);
+    void printComparison() const;
+    void decodeBiphase(unsigned biphase, float reliability,
+        std::vector<SoftBit>* bits);
+    const int stream_;
+    std::string label_;
+    const float carrier_frequency_;
     int   numsamples_;
+    // Input sample index of the next decimated sample into the chain
+    uint64_t sample_index_;
+    // Samples from the start of a bit to its decision
+    const uint64_t bit_latency_;
 
-    std::deque<int> bit_buffer_;
+    std::deque<SoftBit> bit_buffer_;
 
-    liquid::FIRFilter fir_lpf_;
+    // The DSP objects of the float chain, or of the integer-only one used
+    // instead with -F; only the one in use is built
+    struct FloatChain;
+    struct FixedChain;
+    std::unique_ptr<FloatChain> float_;
 
     bool is_eof_;
 
-    liquid::AGC agc_;
-    liquid::NCO nco_approx_;
-    liquid::NCO nco_exact_;
-
-    liquid::SymSync symsync_;
-
-    liquid::Modem modem_;
+    // The pilot PLL replaces the first NCO when a stereo pilot is present
+    // (-P); stream 0 only
+    const bool use_pilot_;
+    bool is_pilot_locked_;
+    // Applied to the output of either, so that switching between them
+    // doesn't step the carrier phase
+    std::complex<float> carrier_rotation_;
+
+    // Between the symbol sync and the modem, with -e
+    const bool use_equalizer_;
+    // Real part of the last equalized symbol
+    float prev_equalized_;
+    float symbol_amplitude_;
+    EqualizerStats equalizer_stats_;
+
+    // Coarse carrier offset estimation at startup and after sync loss
+    std::vector<std::complex<float>> acquisition_buffer_;
+    bool is_acquiring_;
+    bool is_tracking_;
 
     unsigned symbol_clock_;
     unsigned prev_biphase_;
+    float prev_reliability_;
 
     DeltaDecoder delta_decoder_;
 
     unsigned symbol_errors_;
 
+    // Band energy detector that idles the chain when there's no RDS (-g)
+    const bool use_rds_gate_;
+    std::vector<dsp::Goertzel> rds_tones_;
+    std::vector<dsp::Goertzel> noise_tones_;
+    float rds_energy_;
+    float noise_energy_;
+    bool is_rds_present_;
+    int buffers_since_rds_;
+    std::deque<std::vector<int16_t>> preroll_;
+    uint64_t samples_read_;
+    uint64_t rds_start_;
+    uint64_t rds_end_;
+    std::function<void(double start, double end)> rds_range_handler_;
+    std::function<void(const std::string& line)> diagnostic_handler_;
+    bool has_gap_;
+
+    const bool use_fixed_point_;
+    std::unique_ptr<FixedChain> fixed_;
+    int32_t fixed_phase_error_;
+
+    // The float chain run alongside for comparison (-C), and the bits of
+    // either chain not yet paired
+    std::unique_ptr<Subcarrier> reference_;
+    std::deque<SoftBit> unpaired_fixed_;
+    std::deque<SoftBit> unpaired_float_;
+    FixedPointComparison comparison_;
+
+    const bool use_cycle_counter_;
+    DemodStats stats_;
+
+};
+
+// Mixes several MPX streams down to baseband and lowpass filters them in
+// lockstep. State is kept in structure-of-arrays form (one array element per
+// stream, padded to a multiple of kLaneWidth) and processed one vector at a
+// time, so that every operation advances 4, 8 or 16 streams, depending on
+// the instruction set found at startup (SSE or NEON, AVX2, AVX-512). Returns
+// the decimated baseband of each stream, to be passed to
+// Subcarrier::demodulateBaseband(); the rest of the chain runs at 1/24 of the
+// input rate.
+class SubcarrierBank {
+  public:
+    SubcarrierBank(int num_streams);
+    std::vector<std::vector<std::complex<float>>> demodulate(
+        const std::vector<std::vector<int16_t>>& samples);
+
+  private:
+    const int num_streams_;
+    const int num_blocks_;
+    int numsamples_;
+    std::vector<float> taps_;
+    int history_pos_;
+    std::vector<float> history_re_;
+    std::vector<float> history_im_;
+    std::vector<float> phasor_re_;
+    std::vector<float> phasor_im_;
+    std::vector<float> rotation_re_;
+    std::vector<float> rotation_im_;
+    std::vector<std::vector<int16_t>> pending_;
 };
 
 } // namespace redsea
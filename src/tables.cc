@@ -6,28 +6,53 @@
 
 namespace redsea {
 
-std::string getLCDchar(int code) {
-  std::string result(" ");
-  static const std::vector<std::string> char_map ({
-      " ","!","\\\"","#","¤","%","&","'","(",")","*","+",",","-",".","/",
-      "0","1","2","3","4","5","6","7","8","9",":",";","<","=",">","?",
-      "@","A","B","C","D","E","F","G","H","I","J","K","L","M","N","O",
-      "P","Q","R","S","T","U","V","W","X","Y","Z","[","\\","]","―","_",
-      "‖","a","b","c","d","e","f","g","h","i","j","k","l","m","n","o",
-      "p","q","r","s","t","u","v","w","x","y","z","{","|","}","¯"," ",
-      "á","à","é","è","í","ì","ó","ò","ú","ù","Ñ","Ç","Ş","β","¡","Ĳ",
-      "â","ä","ê","ë","î","ï","ô","ö","û","ü","ñ","ç","ş","ǧ","ı","ĳ",
-      "ª","α","©","‰","Ǧ","ě","ň","ő","π","€","£","$","←","↑","→","↓",
-      "º","¹","²","³","±","İ","ń","ű","µ","¿","÷","°","¼","½","¾","§",
-      "Á","À","É","È","Í","Ì","Ó","Ò","Ú","Ù","Ř","Č","Š","Ž","Ð","Ŀ",
-      "Â","Ä","Ê","Ë","Î","Ï","Ô","Ö","Û","Ü","ř","č","š","ž","đ","ŀ",
-      "Ã","Å","Æ","Œ","ŷ","Ý","Õ","Ø","Þ","Ŋ","Ŕ","Ć","Ś","Ź","Ŧ","ð",
-      "ã","å","æ","œ","ŵ","ý","õ","ø","þ","ŋ","ŕ","ć","ś","ź","ŧ"," "});
+namespace {
+
+constexpr size_t cstrlen(const char* str) {
+  return *str == '\0' ? 0 : 1 + cstrlen(str + 1);
+}
+
+// UTF-8 bytes of a character, with their length precomputed
+struct LCDChar {
+  constexpr LCDChar(const char* _bytes) : bytes(_bytes),
+    length(cstrlen(_bytes)) {}
+  const char* bytes;
+  size_t length;
+};
+
+// The basic RDS character set (codes 32-255)
+constexpr LCDChar kLCDChars[] = {
+  " ","!","\\\"","#","¤","%","&","'","(",")","*","+",",","-",".","/",
+  "0","1","2","3","4","5","6","7","8","9",":",";","<","=",">","?",
+  "@","A","B","C","D","E","F","G","H","I","J","K","L","M","N","O",
+  "P","Q","R","S","T","U","V","W","X","Y","Z","[","\\","]","―","_",
+  "‖","a","b","c","d","e","f","g","h","i","j","k","l","m","n","o",
+  "p","q","r","s","t","u","v","w","x","y","z","{","|","}","¯"," ",
+  "á","à","é","è","í","ì","ó","ò","ú","ù","Ñ","Ç","Ş","β","¡","Ĳ",
+  "â","ä","ê","ë","î","ï","ô","ö","û","ü","ñ","ç","ş","ǧ","ı","ĳ",
+  "ª","α","©","‰","Ǧ","ě","ň","ő","π","€","£","$","←","↑","→","↓",
+  "º","¹","²","³","±","İ","ń","ű","µ","¿","÷","°","¼","½","¾","§",
+  "Á","À","É","È","Í","Ì","Ó","Ò","Ú","Ù","Ř","Č","Š","Ž","Ð","Ŀ",
+  "Â","Ä","Ê","Ë","Î","Ï","Ô","Ö","Û","Ü","ř","č","š","ž","đ","ŀ",
+  "Ã","Å","Æ","Œ","ŷ","Ý","Õ","Ø","Þ","Ŋ","Ŕ","Ć","Ś","Ź","Ŧ","ð",
+  "ã","å","æ","œ","ŵ","ý","õ","ø","þ","ŋ","ŕ","ć","ś","ź","ŧ"," "
+};
+
+const int kNumLCDChars = sizeof(kLCDChars) / sizeof(kLCDChars[0]);
 
+}
+
+void appendLCDchar(std::string* str, int code) {
   int idx = code - 32;
-  if (idx >= 0 && idx < (int)char_map.size())
-    result = char_map[idx];
+  if (idx >= 0 && idx < kNumLCDChars)
+    str->append(kLCDChars[idx].bytes, kLCDChars[idx].length);
+  else
+    str->push_back(' ');
+}
 
+std::string getLCDchar(int code) {
+  std::string result;
+  appendLCDchar(&result, code);
   return result;
 }
 
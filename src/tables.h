@@ -6,6 +6,8 @@
 namespace redsea {
 
 std::string getLCDchar(int code);
+// The same without a temporary string
+void appendLCDchar(std::string* str, int code);
 std::string getPTYname(int pty);
 std::string getCountryString(uint16_t pi, uint16_t ecc);
 std::string getLanguageString(uint16_t code);
@@ -15,9 +15,6 @@ namespace tmc {
 
 namespace {
 
-std::map<uint16_t,Event> g_event_data;
-std::map<uint16_t,std::string> g_suppl_data;
-
 uint16_t popBits(std::deque<int>* bit_deque, int len) {
   uint16_t result = 0x00;
   if ((int)bit_deque->size() >= len) {
@@ -210,7 +207,6 @@ std::string getDescWithQuantifier(const Event& event, uint16_t q_value) {
     q = "of up to " + std::to_string(q_value) + " millimetres";
 
   } else {
-    printf("/*q_value = %d, q_type=%d*/",q_value,event.quantifier_type);
     q = "TODO";
 
   }
@@ -226,11 +222,12 @@ std::string ucfirst(std::string in) {
   return in;
 }
 
-void loadEventData() {
+std::map<uint16_t, Event> loadEventData() {
+  std::map<uint16_t, Event> result;
   std::ifstream in("data/tmc_events.csv");
 
   if (!in.is_open())
-    return;
+    return result;
 
   for (std::string line; std::getline(in, line); ) {
     if (!in.good())
@@ -256,17 +253,23 @@ void loadEventData() {
     }
     bool allow_q = (strings[1].size() > 0);
 
-    g_event_data.insert({code, {strings[0], strings[1], nums[0], nums[1],
+    result.insert({code, {strings[0], strings[1], nums[0], nums[1],
         nums[2], nums[3], nums[4], nums[5], allow_q}});
 
   }
 
   in.close();
 
-  in.open("data/tmc_suppl.csv");
+  return result;
+
+}
+
+std::map<uint16_t, std::string> loadSupplementaryData() {
+  std::map<uint16_t, std::string> result;
+  std::ifstream in("data/tmc_suppl.csv");
 
   if (!in.is_open())
-    return;
+    return result;
 
   for (std::string line; std::getline(in, line); ) {
     if (!in.good())
@@ -281,12 +284,26 @@ void loadEventData() {
 
     code = std::stoi(code_str);
 
-    g_suppl_data.insert({code, desc});
+    result.insert({code, desc});
 
   }
 
   in.close();
 
+  return result;
+
+}
+
+// The event tables are loaded on first use (thread-safe) and shared,
+// read-only, by all decoder instances
+const std::map<uint16_t, Event>& eventData() {
+  static const std::map<uint16_t, Event> data = loadEventData();
+  return data;
+}
+
+const std::map<uint16_t, std::string>& supplementaryData() {
+  static const std::map<uint16_t, std::string> data = loadSupplementaryData();
+  return data;
 }
 
 std::map<uint16_t, ServiceKey> loadServiceKeyTable() {
@@ -330,11 +347,11 @@ std::map<uint16_t, ServiceKey> loadServiceKeyTable() {
 }
 
 bool isValidEventCode(uint16_t code) {
-  return g_event_data.count(code) != 0;
+  return eventData().count(code) != 0;
 }
 
 bool isValidSupplementaryCode(uint16_t code) {
-  return g_suppl_data.count(code) != 0;
+  return supplementaryData().count(code) != 0;
 }
 
 } // namespace
@@ -355,8 +372,8 @@ Event::Event(std::string _desc, std::string _desc_q, uint16_t _nature,
 
 Event getEvent(uint16_t code) {
 
-  if (g_event_data.find(code) != g_event_data.end())
-    return g_event_data.find(code)->second;
+  if (eventData().find(code) != eventData().end())
+    return eventData().find(code)->second;
   else
     return Event();
 
@@ -368,22 +385,20 @@ TMC::TMC() : is_initialized_(false), is_encrypted_(false), has_encid_(false),
 
 }
 
-void TMC::systemGroup(uint16_t message) {
+void TMC::systemGroup(uint16_t message, std::string* json) {
 
   if (bits(message, 14, 1) == 0) {
-    printf(",\"tmc\":{\"system_info\":{");
+    appendf(json, ",\"tmc\":{\"system_info\":{");
 
-    if (g_event_data.empty())
-      loadEventData();
 
     is_initialized_ = true;
     ltn_ = bits(message, 6, 6);
     is_encrypted_ = (ltn_ == 0);
 
-    printf("\"is_encrypted\":\"%s\"", is_encrypted_ ? "true" : "false");
+    appendf(json, "\"is_encrypted\":\"%s\"", is_encrypted_ ? "true" : "false");
 
     if (!is_encrypted_)
-      printf(",\"location_table\":\"0x%02x\"", ltn_);
+      appendf(json, ",\"location_table\":\"0x%02x\"", ltn_);
 
     bool afi   = bits(message, 5, 1);
     //bool m     = bits(message, 4, 1);
@@ -392,7 +407,10 @@ void TMC::systemGroup(uint16_t message) {
     bool mgs_r = bits(message, 1, 1);
     bool mgs_u = bits(message, 0, 1);
 
-    printf(",\"is_on_alt_freqs\":\"%s\"", afi ? "true" : "false");
+    appendf(json, ",\"is_on_alt_freqs\":\"%s\"", afi ? "true" : "false");
+
+    if (json == nullptr)
+      return;
 
     std::vector<std::string> scope;
     if (mgs_i)
@@ -404,14 +422,15 @@ void TMC::systemGroup(uint16_t message) {
     if (mgs_u)
       scope.push_back("\"urban\"");
 
-    printf(",\"scope\":[%s]", join(scope, ",").c_str());
+    appendf(json, ",\"scope\":[%s]", join(scope, ",").c_str());
 
-    printf("}}");
+    appendf(json, "}}");
   }
 
 }
 
-void TMC::userGroup(uint16_t x, uint16_t y, uint16_t z) {
+void TMC::userGroup(uint16_t x, uint16_t y, uint16_t z,
+    std::string* json) {
 
   if (!is_initialized_)
     return;
@@ -425,7 +444,7 @@ void TMC::userGroup(uint16_t x, uint16_t y, uint16_t z) {
     ltnbe_ = bits(z, 10, 6);
     has_encid_ = true;
 
-    printf(",\"tmc\":{\"encryption_info\":{\"service_id\":\"0x%02x\","
+    appendf(json, ",\"tmc\":{\"encryption_info\":{\"service_id\":\"0x%02x\","
            "\"encryption_id\":\"0x%02x\","
            "\"location_table\":\"0x%02x\"}}", sid_, encid_, ltnbe_);
 
@@ -442,12 +461,12 @@ void TMC::userGroup(uint16_t x, uint16_t y, uint16_t z) {
       ps_.setAt(pos+2, bits(z, 8, 8));
       ps_.setAt(pos+3, bits(z, 0, 8));
 
-      if (ps_.isComplete())
-        printf(",\"tmc\":{\"service_provider\":\"%s\"}",
+      if (ps_.isComplete() && json != nullptr)
+        appendf(json, ",\"tmc\":{\"service_provider\":\"%s\"}",
             ps_.getLastCompleteString().c_str());
 
     } else {
-      printf(",\"tmc\":{/* TODO: tuning info variant %d */}", variant);
+      appendf(json, ",\"tmc\":{/* TODO: tuning info variant %d */}", variant);
     }
 
   // User message
@@ -465,7 +484,7 @@ void TMC::userGroup(uint16_t x, uint16_t y, uint16_t z) {
       if (is_encrypted_ && service_key_table_.count(encid_) > 0)
         message.decrypt(service_key_table_[encid_]);
 
-      message.print();
+      message.print(json);
       current_ci_ = 0;
 
     // Part of multi-group message
@@ -478,7 +497,7 @@ void TMC::userGroup(uint16_t x, uint16_t y, uint16_t z) {
         /* Message changed; print previous unfinished message
          * TODO 15-second limit */
         Message message(true, is_encrypted_, multi_group_buffer_);
-        message.print();
+        message.print(json);
         for (auto& g : multi_group_buffer_)
           g.is_received = false;
         current_ci_ = continuity_index;
@@ -508,7 +527,8 @@ Message::Message(bool is_multi, bool is_loc_encrypted,
     location_(0), is_complete_(false), has_length_affected_(false),
     length_affected_(0), has_time_until_(false), time_until_(0),
     has_time_starts_(false), time_starts_(0), has_speed_limit_(false),
-    speed_limit_(0), directionality_(DIR_SINGLE), urgency_(URGENCY_NONE) {
+    speed_limit_(0), directionality_(DIR_SINGLE), urgency_(URGENCY_NONE),
+    comments_() {
 
   // single-group
   if (!is_multi) {
@@ -574,7 +594,8 @@ Message::Message(bool is_multi, bool is_loc_encrypted,
           } else if (field_data == 7) {
             extent_ += 16;
           } else {
-            printf("/* TODO: TMC control code %d */",field_data);
+            appendf(&comments_, "/* TODO: TMC control code %d */",
+                field_data);
           }
 
         // Length of route affected
@@ -594,7 +615,7 @@ Message::Message(bool is_multi, bool is_loc_encrypted,
               getQuantifierSize(getEvent(events_.back()).quantifier_type) == 5) {
             quantifiers_.insert({events_.size()-1, field_data});
           } else {
-            printf("/* ignoring invalid quantifier */");
+            appendf(&comments_, "/* ignoring invalid quantifier */");
           }
 
         // 8-bit quantifier
@@ -604,7 +625,7 @@ Message::Message(bool is_multi, bool is_loc_encrypted,
               getQuantifierSize(getEvent(events_.back()).quantifier_type) == 8) {
             quantifiers_.insert({events_.size()-1, field_data});
           } else {
-            printf("/* ignoring invalid quantifier */");
+            appendf(&comments_, "/* ignoring invalid quantifier */");
           }
 
         // Supplementary info
@@ -632,7 +653,8 @@ Message::Message(bool is_multi, bool is_loc_encrypted,
         } else if (label == 14) {
 
         } else {
-          printf("/* TODO label=%d data=0x%04x */",label,field_data);
+          appendf(&comments_, "/* TODO label=%d data=0x%04x */", label,
+              field_data);
         }
       }
     }
@@ -640,18 +662,23 @@ Message::Message(bool is_multi, bool is_loc_encrypted,
 
 }
 
-void Message::print() const {
-  printf(",\"tmc\":{\"message\":{");
+void Message::print(std::string* json) const {
+  if (json == nullptr)
+    return;
+
+  *json += comments_;
+  appendf(json, ",\"tmc\":{\"message\":{");
 
   if (!is_complete_ || events_.empty()) {
-    printf("/* incomplete */}}");
+    appendf(json, "/* incomplete */}}");
     return;
   }
 
-  printf("\"event_codes\":[%s]", join(events_, ",").c_str());
+  appendf(json, "\"event_codes\":[%s]", join(events_, ",").c_str());
 
   if (supplementary_.size() > 0)
-    printf(",\"supplementary_codes\":[%s]", join(supplementary_, ",").c_str());
+    appendf(json, ",\"supplementary_codes\":[%s]",
+        join(supplementary_, ",").c_str());
 
   std::vector<std::string> sentences;
   for (size_t i=0; i<events_.size(); i++) {
@@ -669,20 +696,20 @@ void Message::print() const {
 
   for (uint16_t code : supplementary_) {
     if (isValidSupplementaryCode(code))
-      sentences.push_back(ucfirst(g_suppl_data.find(code)->second));
+      sentences.push_back(ucfirst(supplementaryData().find(code)->second));
   }
 
-  printf(",\"description\":\"%s\"",
+  appendf(json, ",\"description\":\"%s\"",
       std::string(join(sentences, ". ") + ".").c_str());
 
   if (!diversion_.empty()) {
-    printf(",\"diversion_route\":[%s]", join(diversion_, ",").c_str());
+    appendf(json, ",\"diversion_route\":[%s]", join(diversion_, ",").c_str());
   }
 
   if (has_speed_limit_)
-    printf(",\"speed_limit\":\"%d km/h\"", speed_limit_);
+    appendf(json, ",\"speed_limit\":\"%d km/h\"", speed_limit_);
 
-  printf(",\"%slocation\":%d,\"direction\":\"%s\",\"extent\":\"%s%d\","
+  appendf(json, ",\"%slocation\":%d,\"direction\":\"%s\",\"extent\":\"%s%d\","
          "\"diversion_advised\":\"%s\"",
          (is_encrypted_ ? "encrypted_" : ""), location_,
          directionality_ == DIR_SINGLE ? "single" : "both",
@@ -691,12 +718,12 @@ void Message::print() const {
 
 
   if (has_time_starts_)
-    printf(",\"starts\":\"%s\"", timeString(time_starts_).c_str());
+    appendf(json, ",\"starts\":\"%s\"", timeString(time_starts_).c_str());
   if (has_time_until_)
-    printf(",\"until\":\"%s\"", timeString(time_until_).c_str());
+    appendf(json, ",\"until\":\"%s\"", timeString(time_until_).c_str());
 
 
-  printf ("}}");
+  appendf(json, "}}");
 
 }
 
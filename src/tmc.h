@@ -2,6 +2,7 @@
 #define TMC_H_
 
 #include <map>
+#include <string>
 #include <vector>
 
 #include "rdsstring.h"
@@ -69,8 +70,9 @@ struct MessagePart {
 class TMC {
   public:
     TMC();
-    void systemGroup(uint16_t message);
-    void userGroup(uint16_t x, uint16_t y, uint16_t z);
+    // Decoded fields are appended to json as JSON members
+    void systemGroup(uint16_t message, std::string* json);
+    void userGroup(uint16_t x, uint16_t y, uint16_t z, std::string* json);
 
   private:
     void newMessage(bool,std::vector<MessagePart>);
@@ -93,7 +95,7 @@ class Message {
     Message(bool is_multi, bool is_loc_encrypted,
         std::vector<MessagePart> parts);
     std::string toString() const;
-    void print() const;
+    void print(std::string* json) const;
     void decrypt(ServiceKey);
 
   private:
@@ -119,6 +121,8 @@ class Message {
     uint16_t speed_limit_;
     uint16_t directionality_;
     uint16_t urgency_;
+    // Notes from parsing, printed before the message
+    std::string comments_;
 };
 
 } // namespace tmc
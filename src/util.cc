@@ -1,5 +1,11 @@
 #include "util.h"
 
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+
 namespace redsea {
 
 // extract len bits from word, starting at starting_at from the right
@@ -27,4 +33,104 @@ std::string join(std::vector<std::uint16_t> nums, std::string d) {
   return result;
 }
 
+std::vector<std::string> split(const std::string& str, char delimiter) {
+  std::vector<std::string> result;
+  size_t start = 0;
+  size_t end;
+  while ((end = str.find(delimiter, start)) != std::string::npos) {
+    result.push_back(str.substr(start, end - start));
+    start = end + 1;
+  }
+  result.push_back(str.substr(start));
+  return result;
+}
+
+// "98.5M", "2400k" or "2400000" to Hz; throws std::invalid_argument, or
+// std::out_of_range if it doesn't fit a double
+double parseFrequency(std::string str) {
+  size_t idx;
+  double result = std::stod(str, &idx);
+  if (!std::isfinite(result) || idx + 1 < str.length())
+    throw std::invalid_argument(str);
+  if (idx < str.length()) {
+    if (str[idx] == 'k' || str[idx] == 'K')
+      result *= 1e3;
+    else if (str[idx] == 'M')
+      result *= 1e6;
+    else if (str[idx] == 'G')
+      result *= 1e9;
+    else
+      throw std::invalid_argument(str);
+  }
+  return result;
+}
+
+// "2023-02-25T12:34:56.5Z" (UTC) or seconds since the epoch to seconds
+// since the epoch; throws std::invalid_argument
+double parseTime(std::string str) {
+  int yr, mo, dy, hr, mn, len = 0;
+  double sec;
+  if (sscanf(str.c_str(), "%d-%d-%dT%d:%d:%lf%n", &yr, &mo, &dy, &hr, &mn,
+             &sec, &len) == 6) {
+    if (str.substr(len) != "" && str.substr(len) != "Z")
+      throw std::invalid_argument(str);
+    struct tm t = {};
+    t.tm_year = yr - 1900;
+    t.tm_mon  = mo - 1;
+    t.tm_mday = dy;
+    t.tm_hour = hr;
+    t.tm_min  = mn;
+    return timegm(&t) + sec;
+  }
+
+  size_t idx;
+  double result = std::stod(str, &idx);
+  if (idx < str.length())
+    throw std::invalid_argument(str);
+  return result;
+}
+
+std::string formatTime(double seconds, const char* format, int decimals) {
+  long long scale = 1;
+  for (int i=0; i<decimals; i++)
+    scale *= 10;
+  long long ticks = std::llround(seconds * scale);
+  time_t whole = ticks / scale;
+
+  struct tm t;
+  gmtime_r(&whole, &t);
+  char buf[64];
+  strftime(buf, sizeof(buf), format, &t);
+
+  std::string result(buf);
+  if (decimals > 0)
+    appendf(&result, ".%0*lld", decimals, ticks % scale);
+  return result;
+}
+
+void appendf(std::string* str, const char* format, ...) {
+  if (str == nullptr)
+    return;
+
+  char buf[256];
+  va_list args;
+
+  va_start(args, format);
+  int len = std::vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+
+  if (len < 0)
+    return;
+
+  if (size_t(len) < sizeof(buf)) {
+    str->append(buf, len);
+  } else {
+    std::vector<char> longbuf(len + 1);
+    va_start(args, format);
+    std::vsnprintf(longbuf.data(), longbuf.size(), format, args);
+    va_end(args);
+    str->append(longbuf.data(), len);
+  }
+}
+
 } // namespace redsea
@@ -12,5 +12,19 @@ uint16_t bits (uint16_t word, int starting_at, int len);
 std::string join(std::vector<std::string> strings, std::string);
 std::string join(std::vector<uint16_t> strings, std::string);
 
+std::vector<std::string> split(const std::string& str, char delimiter);
+
+double parseFrequency(std::string str);
+
+double parseTime(std::string str);
+// Seconds since the epoch as UTC in the strftime format, with the given
+// number of decimals of seconds appended
+std::string formatTime(double seconds, const char* format, int decimals);
+
+// printf-style formatting appended to a string; does nothing if str is
+// null, so that output can be switched off
+void appendf(std::string* str, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
 } // namespace redsea
 #endif // UTIL_H_
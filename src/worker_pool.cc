@@ -0,0 +1,75 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace redsea {
+
+WorkerPool::WorkerPool(unsigned num_workers) :
+  num_workers_(num_workers > 0 ? num_workers :
+      std::max(1u, std::thread::hardware_concurrency())),
+  threads_(), func_(nullptr), num_items_(0), next_item_(0), generation_(0),
+  num_busy_(0), is_stopping_(false) {
+
+  for (unsigned w=0; w<num_workers_; w++)
+    threads_.push_back(std::thread(&WorkerPool::work, this));
+
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_stopping_ = true;
+  }
+  has_work_.notify_all();
+
+  for (std::thread& thread : threads_)
+    thread.join();
+}
+
+void WorkerPool::run(unsigned num_items,
+    const std::function<void(unsigned)>& func) {
+
+  if (num_items == 0)
+    return;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  func_ = &func;
+  num_items_ = num_items;
+  next_item_ = 0;
+  num_busy_ = num_workers_;
+  generation_ ++;
+  has_work_.notify_all();
+
+  is_done_.wait(lock, [this]() { return num_busy_ == 0; });
+  func_ = nullptr;
+
+}
+
+// Items are taken one at a time, so that a slow one doesn't hold back the
+// rest of a worker's share
+void WorkerPool::work() {
+  unsigned generation = 0;
+
+  while (true) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    has_work_.wait(lock, [this, generation]() {
+      return is_stopping_ || generation_ != generation;
+    });
+    if (is_stopping_)
+      return;
+    generation = generation_;
+    const std::function<void(unsigned)>& func = *func_;
+    const unsigned num_items = num_items_;
+    lock.unlock();
+
+    for (unsigned i = next_item_++; i < num_items; i = next_item_++)
+      func(i);
+
+    lock.lock();
+    num_busy_ --;
+    if (num_busy_ == 0)
+      is_done_.notify_one();
+  }
+}
+
+} // namespace redsea
@@ -0,0 +1,43 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace redsea {
+
+// Threads that are started once and then run the iterations of one loop at
+// a time, so that decoding a chunk of input doesn't start and join a thread
+// per stream
+class WorkerPool {
+  public:
+    // One worker per CPU if num_workers is 0
+    explicit WorkerPool(unsigned num_workers=0);
+    ~WorkerPool();
+    // Calls func(i) for each i below num_items, in parallel; returns when
+    // all calls have returned
+    void run(unsigned num_items, const std::function<void(unsigned)>& func);
+
+  private:
+    void work();
+
+    const unsigned num_workers_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::condition_variable is_done_;
+    const std::function<void(unsigned)>* func_;
+    unsigned num_items_;
+    std::atomic<unsigned> next_item_;
+    // Incremented by each run(), for the workers to notice new work
+    unsigned generation_;
+    unsigned num_busy_;
+    bool is_stopping_;
+};
+
+} // namespace redsea
+#endif // WORKER_POOL_H_